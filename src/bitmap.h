@@ -0,0 +1,72 @@
+#pragma once
+
+// Битовое множество внутренних номеров документов (фильтры запроса).
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+class DocBitmap {
+public:
+    DocBitmap() = default;
+    explicit DocBitmap(uint32_t num_docs) { resize(num_docs); }
+
+    void resize(uint32_t num_docs) {
+        size_ = num_docs;
+        words_.assign((num_docs + 63) / 64, 0);
+    }
+
+    uint32_t size() const { return size_; }
+    void set(uint32_t d) { words_[d >> 6] |= 1ULL << (d & 63); }
+    bool test(uint32_t d) const { return d < size_ && (words_[d >> 6] >> (d & 63)) & 1; }
+
+    uint64_t count() const {
+        uint64_t n = 0;
+        for (uint64_t w : words_) n += (uint64_t)__builtin_popcountll(w);
+        return n;
+    }
+
+    // Номера документов по возрастанию.
+    void to_docs(std::vector<uint32_t>& out) const {
+        out.clear();
+        for (size_t i = 0; i < words_.size(); i++) {
+            for (uint64_t w = words_[i]; w; w &= w - 1) {
+                out.push_back((uint32_t)(i * 64 + (size_t)__builtin_ctzll(w)));
+            }
+        }
+    }
+
+    const std::vector<uint64_t>& words() const { return words_; }
+
+private:
+    uint32_t size_ = 0;
+    std::vector<uint64_t> words_;
+};
+
+// Битовая карта в файле индекса (плотный ярус термов): только чтение,
+// побайтно, потому что начало карты не выровнено.
+class DocBitmapView {
+public:
+    DocBitmapView(const uint8_t* bits, uint32_t num_docs) : bits_(bits), size_(num_docs) {}
+
+    uint32_t size() const { return size_; }
+    bool test(uint32_t d) const { return d < size_ && (bits_[d >> 3] >> (d & 7)) & 1; }
+
+    void to_docs(std::vector<uint32_t>& out) const {
+        out.clear();
+        const uint32_t bytes = (size_ + 7) / 8;
+        uint32_t i = 0;
+        for (; i + 8 <= bytes; i += 8) {
+            uint64_t w;
+            std::memcpy(&w, bits_ + i, sizeof(w));
+            for (; w; w &= w - 1) out.push_back(i * 8 + (uint32_t)__builtin_ctzll(w));
+        }
+        for (; i < bytes; i++) {
+            for (uint32_t b = bits_[i]; b; b &= b - 1) out.push_back(i * 8 + (uint32_t)__builtin_ctz(b));
+        }
+    }
+
+private:
+    const uint8_t* bits_;
+    uint32_t size_;
+};
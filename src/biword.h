@@ -0,0 +1,77 @@
+#pragma once
+
+// Индекс биграмм (biword) для фразовых запросов: для K самых частых пар
+// соседних стемов хранится отдельный список словопозиций "a b" (позиция -
+// позиция первого слова) в data/biword_index.bin того же формата, что и
+// основной индекс. Фраза из двух слов с такой парой - один список без
+// проверки позиций; в длинной фразе перекрывающиеся биграммы пересекаются
+// первыми, и позиции проверяются по их (более коротким) спискам.
+//
+// Пары отбираются за один проход по потоку токенов счетчиком Мисры-Гриса:
+// capacity счетчиков, при переполнении все уменьшаются на 1, и пары с нулем
+// выбывают. Пара с частотой больше N / (capacity + 1) гарантированно
+// остается в счетчике.
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Терм биграммы в словаре biword_index.bin.
+inline std::string biword_term(std::string_view a, std::string_view b) {
+    std::string out;
+    out.reserve(a.size() + b.size() + 1);
+    out.append(a).push_back(' ');
+    out.append(b);
+    return out;
+}
+
+class FrequentPairs {
+public:
+    explicit FrequentPairs(size_t capacity) : capacity_(std::max<size_t>(capacity, 1)) {
+        counts_.reserve(capacity_ + 1);
+    }
+
+    void add(uint32_t a, uint32_t b) {
+        total_++;
+        const uint64_t key = ((uint64_t)a << 32) | b;
+        auto it = counts_.find(key);
+        if (it != counts_.end()) {
+            it->second++;
+            return;
+        }
+        if (counts_.size() < capacity_) {
+            counts_.emplace(key, 1);
+            return;
+        }
+        // Новая пара и все счетчики уменьшаются на 1. Каждый такой проход
+        // снимает capacity + 1 с суммы счетчиков, поэтому в среднем O(1) на пару.
+        for (auto i = counts_.begin(); i != counts_.end();) {
+            if (--i->second == 0) i = counts_.erase(i);
+            else ++i;
+        }
+    }
+
+    // До k пар по убыванию оставшегося счетчика.
+    std::vector<std::pair<uint32_t, uint32_t>> top(size_t k) const {
+        std::vector<std::pair<uint64_t, uint32_t>> all(counts_.begin(), counts_.end());
+        std::sort(all.begin(), all.end(), [](const auto& x, const auto& y) {
+            return x.second != y.second ? x.second > y.second : x.first < y.first;
+        });
+        if (all.size() > k) all.resize(k);
+        std::vector<std::pair<uint32_t, uint32_t>> out;
+        out.reserve(all.size());
+        for (const auto& [key, c] : all) out.emplace_back((uint32_t)(key >> 32), (uint32_t)key);
+        return out;
+    }
+
+    uint64_t total() const { return total_; }
+
+private:
+    size_t capacity_;
+    uint64_t total_ = 0;
+    std::unordered_map<uint64_t, uint32_t> counts_;
+};
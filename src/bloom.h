@@ -0,0 +1,94 @@
+#pragma once
+
+// Блочный фильтр Блума по термам словаря: "терма точно нет" без обращения
+// к хеш-функции и строкам словаря. Фильтр - массив блоков по 512 бит (одна
+// кэш-линия); хеш терма (hash_token) выбирает блок старшими битами, а k бит
+// внутри блока - 9-битными кусками второго хеша. Проверка стоит одного
+// промаха кэша вместо k; доля ложных срабатываний немного выше, чем у
+// обычного фильтра того же размера (~1.2% вместо ~0.8% при 10 битах на терм).
+//
+// Лежит в файле индекса сразу за словарем (флаг kIndexHasBloom):
+//   uint32 число блоков B, uint32 k, B x 8 x uint64.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <vector>
+
+class BloomFilter {
+public:
+    static constexpr uint32_t kBlockWords = 8;
+    static constexpr uint32_t kBlockBits = kBlockWords * 64;
+    static constexpr uint32_t kMaxProbes = 7;   // 7 x 9 бит второго хеша
+
+    // hashes - hash_token всех термов словаря.
+    void build(const std::vector<uint64_t>& hashes, double bits_per_key) {
+        k_ = (uint32_t)std::clamp(std::lround(bits_per_key * 0.6931), 1L, (long)kMaxProbes);
+        const double bits = std::max(1.0, std::ceil((double)hashes.size() * bits_per_key));
+        allocate((uint32_t)std::ceil(bits / kBlockBits));
+        for (uint64_t h : hashes) {
+            uint64_t* b = block(h);
+            uint64_t g = spread(h);
+            for (uint32_t i = 0; i < k_; i++, g <<= 9) {
+                const uint32_t bit = (uint32_t)(g >> 55);
+                b[bit >> 6] |= 1ULL << (bit & 63);
+            }
+        }
+    }
+
+    void write(std::ostream& out) const {
+        out.write(reinterpret_cast<const char*>(&blocks_), sizeof(blocks_));
+        out.write(reinterpret_cast<const char*>(&k_), sizeof(k_));
+        out.write(reinterpret_cast<const char*>(words()), (size_t)blocks_ * kBlockWords * sizeof(uint64_t));
+    }
+
+    // Копия в память, выровненная по кэш-линии; false - данные повреждены.
+    bool load(const char* p, size_t size) {
+        if (size < 8) return false;
+        uint32_t blocks, k;
+        std::memcpy(&blocks, p, 4);
+        std::memcpy(&k, p + 4, 4);
+        if (!blocks || !k || k > kMaxProbes || size - 8 < (size_t)blocks * kBlockWords * sizeof(uint64_t)) return false;
+        k_ = k;
+        allocate(blocks);
+        std::memcpy(words(), p + 8, (size_t)blocks * kBlockWords * sizeof(uint64_t));
+        return true;
+    }
+
+    bool empty() const { return blocks_ == 0; }
+    uint32_t probes() const { return k_; }
+    uint64_t bytes() const { return 8 + (uint64_t)blocks_ * kBlockWords * sizeof(uint64_t); }
+
+    // false - ключа с хешем h точно нет.
+    bool may_contain(uint64_t h) const {
+        const uint64_t* b = block(h);
+        uint64_t g = spread(h);
+        for (uint32_t i = 0; i < k_; i++, g <<= 9) {
+            const uint32_t bit = (uint32_t)(g >> 55);
+            if (!(b[bit >> 6] & (1ULL << (bit & 63)))) return false;
+        }
+        return true;
+    }
+
+private:
+    void allocate(uint32_t blocks) {
+        blocks_ = blocks;
+        storage_.assign((size_t)blocks * kBlockWords + kBlockWords, 0);
+        base_ = (64 - reinterpret_cast<uintptr_t>(storage_.data()) % 64) % 64 / sizeof(uint64_t);
+    }
+
+    uint64_t* words() { return storage_.data() + base_; }
+    const uint64_t* words() const { return storage_.data() + base_; }
+    uint64_t* block(uint64_t h) { return words() + ((h >> 32) * blocks_ >> 32) * kBlockWords; }
+    const uint64_t* block(uint64_t h) const { return words() + ((h >> 32) * blocks_ >> 32) * kBlockWords; }
+
+    // Второй хеш: старшие биты произведения перемешаны со всеми битами h.
+    static uint64_t spread(uint64_t h) { return (h ^ (h >> 29)) * 0x9E3779B97F4A7C15ULL; }
+
+    uint32_t blocks_ = 0;
+    uint32_t k_ = 0;
+    std::vector<uint64_t> storage_;
+    size_t base_ = 0;   // смещение первого блока в storage_
+};
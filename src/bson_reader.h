@@ -0,0 +1,175 @@
+#pragma once
+
+// Чтение дампа mongodump (<collection>.bson) без промежуточного JSONL.
+// Файл - это поток BSON-документов, каждый начинается с int32 длины.
+// Нужные поля возвращаются как string_view прямо в отображенный файл,
+// копирования текста не происходит.
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "mmap_file.h"
+
+struct BsonCorpusDoc {
+    std::string_view normalized_url;
+    std::string_view source_name;
+    std::string_view title;
+    std::string_view clean_text;
+    std::string_view raw_html;    // для ссылок статического ранга (static_rank.h)
+
+    // _id типа ObjectId печатается в hex так же, как str(ObjectId) в export_corpus.py;
+    // строковый _id отдается как есть.
+    std::string_view doc_id() const {
+        return has_oid ? std::string_view(oid_hex, sizeof(oid_hex)) : string_id;
+    }
+
+    std::string_view string_id;
+    bool has_oid = false;
+    char oid_hex[24] = {};
+};
+
+class BsonDumpReader {
+public:
+    bool open(const std::string& path) {
+        pos_ = 0;
+        corrupted_ = false;
+        docs_read_ = docs_skipped_ = 0;
+        return file_.open(path, true);
+    }
+
+    // Возвращает следующий документ с непустым clean_text (как фильтр в export_corpus.py).
+    // false - конец файла или поврежденная запись (см. corrupted()).
+    bool next(BsonCorpusDoc& doc) {
+        while (pos_ + 5 <= file_.size()) {
+            const char* p = file_.data() + pos_;
+            const uint32_t len = read_u32(p);
+            if (len < 5 || pos_ + len > file_.size() || p[len - 1] != '\0') {
+                corrupted_ = true;
+                return false;
+            }
+            pos_ += len;
+            docs_read_++;
+
+            doc = BsonCorpusDoc{};
+            if (!parse_doc(p, len, doc) || doc.doc_id().empty() || doc.clean_text.empty()) {
+                docs_skipped_++;
+                continue;
+            }
+            return true;
+        }
+        if (pos_ != file_.size()) corrupted_ = true;
+        return false;
+    }
+
+    size_t bytes_read() const { return pos_; }
+    size_t file_size() const { return file_.size(); }
+    uint64_t docs_read() const { return docs_read_; }
+    uint64_t docs_skipped() const { return docs_skipped_; }
+    bool corrupted() const { return corrupted_; }
+
+private:
+    static uint32_t read_u32(const char* p) {
+        uint32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    // Размер значения элемента типа type, начинающегося в p; 0 - неизвестный тип или выход за end.
+    static size_t value_size(uint8_t type, const char* p, const char* end) {
+        auto need = [&](size_t n) -> size_t { return (size_t)(end - p) >= n ? n : 0; };
+        switch (type) {
+            case 0x01: case 0x09: case 0x11: case 0x12: return need(8);
+            case 0x02: case 0x0D: case 0x0E: {
+                if (!need(4)) return 0;
+                return need(4 + (size_t)read_u32(p));
+            }
+            case 0x03: case 0x04: case 0x0F: {
+                if (!need(4)) return 0;
+                return need((size_t)read_u32(p));
+            }
+            case 0x05: {
+                if (!need(4)) return 0;
+                return need(5 + (size_t)read_u32(p));
+            }
+            case 0x07: return need(12);
+            case 0x08: return need(1);
+            case 0x0B: {
+                const void* z1 = std::memchr(p, 0, (size_t)(end - p));
+                if (!z1) return 0;
+                const char* q = static_cast<const char*>(z1) + 1;
+                const void* z2 = std::memchr(q, 0, (size_t)(end - q));
+                if (!z2) return 0;
+                return (size_t)(static_cast<const char*>(z2) + 1 - p);
+            }
+            case 0x0C: {
+                if (!need(4)) return 0;
+                return need(4 + (size_t)read_u32(p) + 12);
+            }
+            case 0x10: return need(4);
+            case 0x13: return need(16);
+            default: return 0;
+        }
+    }
+
+    static bool is_empty_type(uint8_t type) {
+        return type == 0x06 || type == 0x0A || type == 0x7F || type == 0xFF;
+    }
+
+    static std::string_view string_value(const char* p) {
+        const uint32_t n = read_u32(p);
+        return n ? std::string_view(p + 4, n - 1) : std::string_view();
+    }
+
+    // Обходит элементы документа [p, p + len); для вложенного metadata рекурсия на один уровень.
+    static bool parse_doc(const char* p, uint32_t len, BsonCorpusDoc& doc, bool in_metadata = false) {
+        const char* end = p + len - 1;
+        p += 4;
+        while (p < end) {
+            const uint8_t type = (uint8_t)*p++;
+            const void* z = std::memchr(p, 0, (size_t)(end - p));
+            if (!z) return false;
+            const std::string_view name(p, (size_t)(static_cast<const char*>(z) - p));
+            p = static_cast<const char*>(z) + 1;
+
+            size_t vsize = is_empty_type(type) ? 0 : value_size(type, p, end);
+            if (vsize == 0 && !is_empty_type(type)) return false;
+
+            if (in_metadata) {
+                if (type == 0x02 && name == "title") doc.title = string_value(p);
+            } else if (name == "_id") {
+                if (type == 0x07) {
+                    static const char* hex = "0123456789abcdef";
+                    for (int i = 0; i < 12; i++) {
+                        doc.oid_hex[2 * i] = hex[(uint8_t)p[i] >> 4];
+                        doc.oid_hex[2 * i + 1] = hex[(uint8_t)p[i] & 0x0F];
+                    }
+                    doc.has_oid = true;
+                } else if (type == 0x02) {
+                    doc.string_id = string_value(p);
+                }
+            } else if (type == 0x02) {
+                if (name == "normalized_url") doc.normalized_url = string_value(p);
+                else if (name == "source_name") doc.source_name = string_value(p);
+                else if (name == "clean_text") doc.clean_text = string_value(p);
+                else if (name == "raw_html") doc.raw_html = string_value(p);
+            } else if (type == 0x03 && name == "metadata") {
+                if (!parse_doc(p, read_u32(p), doc, true)) return false;
+            }
+            p += vsize;
+        }
+        return true;
+    }
+
+    MappedFile file_;
+    size_t pos_ = 0;
+    bool corrupted_ = false;
+    uint64_t docs_read_ = 0;
+    uint64_t docs_skipped_ = 0;
+};
+
+inline bool is_bson_path(const std::string& path) {
+    return path.size() >= 5 && path.compare(path.size() - 5, 5, ".bson") == 0;
+}
@@ -0,0 +1,124 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <iomanip>
+#include <filesystem>
+
+#include "metrics.h"
+#include "qrels.h"
+
+// Офлайн-оценка выдачи: качество (P@k, MAP, nDCG@k, recall@k) по qrels
+// и задержки запросов из <run>.latency, которые пишет searching --run.
+// Каждый прогон дописывается строкой в общий отчет, чтобы варианты индекса
+// и поиска сравнивались сразу по скорости и качеству.
+
+struct EvalOptions {
+    std::string qrels_path;
+    std::string run_path;
+    std::string report_path = "data/eval/report.tsv";
+    std::string tag;
+    size_t k = 10;
+};
+
+int main(int argc, char** argv) {
+    EvalOptions opt;
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; i++) {
+        const std::string a = argv[i];
+        if (a == "--k" && i + 1 < argc) opt.k = std::stoul(argv[++i]);
+        else if (a == "--report" && i + 1 < argc) opt.report_path = argv[++i];
+        else if (a == "--tag" && i + 1 < argc) opt.tag = argv[++i];
+        else positional.push_back(a);
+    }
+    if (positional.size() != 2) {
+        std::cerr << "Использование: eval [--k N] [--tag name] [--report report.tsv] <qrels.tsv> <run.txt>" << std::endl;
+        return 1;
+    }
+    opt.qrels_path = positional[0];
+    opt.run_path = positional[1];
+    if (opt.tag.empty()) opt.tag = std::filesystem::path(opt.run_path).stem().string();
+
+    Qrels qrels;
+    if (!load_qrels(opt.qrels_path, qrels)) {
+        std::cerr << "Не удалось открыть файл оценок " << opt.qrels_path << std::endl;
+        return 1;
+    }
+    std::map<std::string, std::vector<std::string>> run;
+    if (!load_run(opt.run_path, run)) {
+        std::cerr << "Не удалось открыть файл выдачи " << opt.run_path << std::endl;
+        return 1;
+    }
+
+    metrics::Registry reg("eval");
+    auto& m_latency = reg.histogram("query_latency_us", "Время выполнения запроса, мкс");
+    std::ifstream latency_in(opt.run_path + ".latency");
+    std::string topic;
+    uint64_t us = 0;
+    while (latency_in >> topic >> us) m_latency.record(us);
+
+    // Темы без единого релевантного документа не оцениваются; тема из qrels,
+    // по которой нет выдачи, считается с нулевыми значениями.
+    size_t topics = 0;
+    double p_sum = 0.0, ap_sum = 0.0, ndcg_sum = 0.0, recall_sum = 0.0;
+    static const std::vector<std::string> kEmpty;
+    for (const auto& [t, judged] : qrels) {
+        if (count_relevant(judged) == 0) continue;
+        auto it = run.find(t);
+        const std::vector<std::string>& ranked = it != run.end() ? it->second : kEmpty;
+        p_sum += precision_at(judged, ranked, opt.k);
+        ap_sum += average_precision(judged, ranked);
+        ndcg_sum += ndcg_at(judged, ranked, opt.k);
+        recall_sum += recall_at(judged, ranked, opt.k);
+        topics++;
+    }
+    if (topics == 0) {
+        std::cerr << "В qrels нет тем с релевантными документами." << std::endl;
+        return 1;
+    }
+
+    const double p = p_sum / topics;
+    const double map = ap_sum / topics;
+    const double ndcg = ndcg_sum / topics;
+    const double recall = recall_sum / topics;
+
+    std::cout << std::fixed << std::setprecision(4);
+    std::cout << "Прогон: " << opt.tag << ", тем: " << topics << std::endl;
+    std::cout << "P@" << opt.k << ": " << p << std::endl;
+    std::cout << "MAP: " << map << std::endl;
+    std::cout << "nDCG@" << opt.k << ": " << ndcg << std::endl;
+    std::cout << "Recall@" << opt.k << ": " << recall << std::endl;
+    if (m_latency.count() > 0) {
+        std::cout << "Задержка, мкс: p50 " << m_latency.percentile(0.5) << ", p90 " << m_latency.percentile(0.9)
+                  << ", p99 " << m_latency.percentile(0.99) << ", среднее " << m_latency.mean() << std::endl;
+    } else {
+        std::cout << "Задержки не найдены (" << opt.run_path << ".latency)" << std::endl;
+    }
+
+    const std::filesystem::path report(opt.report_path);
+    if (report.has_parent_path()) std::filesystem::create_directories(report.parent_path());
+    const bool fresh = !std::filesystem::exists(report);
+    std::ofstream out(report, std::ios::app);
+    if (!out) {
+        std::cerr << "Не удалось открыть отчет " << opt.report_path << std::endl;
+        return 1;
+    }
+    if (fresh) {
+        out << "tag\ttopics\tk\tP@k\tMAP\tnDCG@k\trecall@k\tp50_us\tp90_us\tp99_us\tmean_us\n";
+    }
+    out << std::fixed << std::setprecision(4) << opt.tag << '\t' << topics << '\t' << opt.k << '\t' << p << '\t'
+        << map << '\t' << ndcg << '\t' << recall << '\t' << m_latency.percentile(0.5) << '\t'
+        << m_latency.percentile(0.9) << '\t' << m_latency.percentile(0.99) << '\t' << m_latency.mean() << '\n';
+    std::cout << "Отчет дополнен: " << opt.report_path << std::endl;
+
+    reg.gauge("topics", "Тем с релевантными документами").set((double)topics);
+    reg.gauge("precision_at_k", "Средняя P@k").set(p);
+    reg.gauge("map", "MAP").set(map);
+    reg.gauge("ndcg_at_k", "Средний nDCG@k").set(ndcg);
+    reg.gauge("recall_at_k", "Средний recall@k").set(recall);
+    if (!metrics::dump_json(reg)) {
+        std::cerr << "Не удалось записать метрики в " << metrics::metrics_dir() << std::endl;
+    }
+    return 0;
+}
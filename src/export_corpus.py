@@ -1,9 +1,26 @@
 import json
+import re
 import sys
 import os
+from urllib.parse import urljoin
 from pymongo import MongoClient
 import yaml
 
+HREF_RE = re.compile(r"""href=["']([^"']+)["']""")
+
+
+def extract_links(html, base_url):
+    # Ссылки страницы для статического ранга (src/static_rank.h): абсолютные
+    # URL, нормализованные как normalized_url в database.py.
+    links = set()
+    for href in HREF_RE.findall(html or ""):
+        if not href.startswith(("/", "http://", "https://")):
+            continue
+        url = urljoin(base_url, href).split("#")[0].split("?")[0]
+        if url and url != base_url:
+            links.add(url)
+    return sorted(links)
+
 
 def main():
     config_path = sys.argv[1] if len(sys.argv) > 1 else "config.yaml"
@@ -22,16 +39,22 @@ def main():
     )
     col = client[db_cfg["database"]][db_cfg["collection"]]
 
-    os.makedirs(os.path.dirname(out_path), exist_ok=True)
+    to_stdout = out_path == "-"
+    if not to_stdout:
+        os.makedirs(os.path.dirname(out_path), exist_ok=True)
 
     processed_doc_ids = set()
 
     cur = col.find(
         {"clean_text": {"$exists": True, "$ne": ""}},
-        {"normalized_url": 1, "clean_text": 1, "source_name": 1, "metadata.title": 1}
+        {"normalized_url": 1, "clean_text": 1, "source_name": 1, "metadata.title": 1, "raw_html": 1}
     )
 
-    with open(out_path, "w", encoding="utf-8") as out:
+    # "-" - писать в stdout, чтобы сразу отдавать корпус токенизатору через пайп
+    out = sys.stdout if to_stdout else open(out_path, "w", encoding="utf-8", buffering=1 << 22)
+    if to_stdout:
+        sys.stdout.reconfigure(encoding="utf-8")
+    try:
         for doc in cur:
             doc_id = str(doc["_id"])
 
@@ -47,10 +70,14 @@ def main():
                 "source_name": doc.get("source_name", ""),
                 "title": title,
                 "clean_text": doc.get("clean_text", ""),
+                "links": extract_links(doc.get("raw_html", ""), doc.get("normalized_url", "")),
             }
             out.write(json.dumps(rec, ensure_ascii=False) + "\n")
+    finally:
+        if not to_stdout:
+            out.close()
 
-    print(f"Exported to {out_path}")
+    print(f"Exported to {out_path}", file=sys.stderr if to_stdout else sys.stdout)
 
 
 if __name__ == "__main__":
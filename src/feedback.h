@@ -0,0 +1,165 @@
+#pragma once
+
+// Псевдорелевантная обратная связь (Rocchio) для ранжированного поиска.
+// Первый проход - обычный WAND по термам запроса; векторы top-R документов
+// читаются из прямого индекса, и запрос расширяется:
+//   q' = alpha * q + beta / R * sum(d / |d|),  d - вектор tf * idf документа.
+// Второй проход - WAND по расширенному запросу. Распакованные списки
+// словопозиций хранятся в LRU-кеше, поэтому термы исходного запроса во втором
+// проходе не распаковываются повторно.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "index_format.h"
+#include "topk.h"
+
+struct DecodedPostings {
+    std::vector<uint32_t> docs;
+    std::vector<uint32_t> tfs;
+    std::vector<uint32_t> impacts;  // только для индекса с квантованными вкладами
+};
+
+// Курсор по распакованному списку, тот же интерфейс, что у PostingIterator.
+class DecodedCursor {
+public:
+    explicit DecodedCursor(std::shared_ptr<const DecodedPostings> list) : list_(std::move(list)) {}
+
+    uint32_t df() const { return (uint32_t)list_->docs.size(); }
+    uint32_t doc() const { return i_ < list_->docs.size() ? list_->docs[i_] : kEndDoc; }
+    uint32_t tf() const { return list_->tfs[i_]; }
+    uint32_t impact() const { return list_->impacts[i_]; }
+    bool at_end() const { return i_ >= list_->docs.size(); }
+    void next() { i_++; }
+
+    // Галоп от текущей позиции, затем двоичный поиск.
+    void next_geq(uint32_t target) {
+        const auto& docs = list_->docs;
+        if (at_end() || docs[i_] >= target) return;
+        size_t step = 1;
+        size_t hi = i_ + 1;
+        while (hi < docs.size() && docs[hi] < target) {
+            i_ = hi;
+            step *= 2;
+            hi = i_ + step;
+        }
+        hi = std::min(hi, docs.size());
+        i_ = (size_t)(std::lower_bound(docs.begin() + i_, docs.begin() + hi, target) - docs.begin());
+    }
+
+private:
+    std::shared_ptr<const DecodedPostings> list_;
+    size_t i_ = 0;
+};
+
+// LRU-кеш распакованных списков, емкость - в постингах.
+class PostingCache {
+public:
+    explicit PostingCache(size_t max_postings) : capacity_(max_postings) {}
+
+    std::shared_ptr<const DecodedPostings> get(const IndexReader& idx, uint32_t term) {
+        auto it = map_.find(term);
+        if (it != map_.end()) {
+            hits_++;
+            lru_.splice(lru_.begin(), lru_, it->second);
+            return it->second->second;
+        }
+        misses_++;
+        auto list = std::make_shared<DecodedPostings>();
+        list->docs.reserve(idx.term(term).df);
+        list->tfs.reserve(idx.term(term).df);
+        for (PostingIterator p = idx.postings(term); !p.at_end(); p.next()) {
+            list->docs.push_back(p.doc());
+            list->tfs.push_back(p.tf());
+            if (idx.has_impacts()) list->impacts.push_back(p.impact());
+        }
+        size_ += list->docs.size();
+        lru_.emplace_front(term, list);
+        map_[term] = lru_.begin();
+        // Только что добавленный список не вытесняется, даже если он больше емкости.
+        while (size_ > capacity_ && lru_.size() > 1) {
+            size_ -= lru_.back().second->docs.size();
+            map_.erase(lru_.back().first);
+            lru_.pop_back();
+        }
+        return list;
+    }
+
+    uint64_t hits() const { return hits_; }
+    uint64_t misses() const { return misses_; }
+
+private:
+    using Entry = std::pair<uint32_t, std::shared_ptr<const DecodedPostings>>;
+
+    size_t capacity_;
+    size_t size_ = 0;
+    std::list<Entry> lru_;
+    std::unordered_map<uint32_t, std::list<Entry>::iterator> map_;
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+};
+
+inline std::vector<ScoredDoc> wand_topk_cached(const IndexReader& idx, PostingCache& cache,
+                                               const std::vector<WeightedTerm>& terms, size_t k,
+                                               TopKStats* stats = nullptr, const StaticPrior& prior = StaticPrior()) {
+    std::vector<WandCursor<DecodedCursor>> cursors;
+    cursors.reserve(terms.size());
+    for (const auto& t : terms) {
+        if (t.weight <= 0.0f) continue;
+        cursors.push_back({DecodedCursor(cache.get(idx, t.term)), t.weight * idx.posting_weight(t.term),
+                           t.weight * idx.term(t.term).max_score});
+    }
+    return wand_run(idx, cursors, k, kEndDoc, stats, prior);
+}
+
+struct RocchioParams {
+    size_t docs = 10;          // R - сколько документов первого прохода считать релевантными
+    size_t expansion = 10;     // сколько новых термов добавить
+    float alpha = 1.0f;
+    float beta = 0.75f;
+};
+
+inline std::vector<WeightedTerm> rocchio_expand(const IndexReader& idx, const std::vector<WeightedTerm>& query,
+                                                const std::vector<ScoredDoc>& top, const RocchioParams& p) {
+    std::unordered_map<uint32_t, float> centroid;
+    const size_t r = std::min(p.docs, top.size());
+    std::vector<std::pair<uint32_t, uint32_t>> vec;
+    for (size_t i = 0; i < r; i++) {
+        idx.forward(top[i].doc, vec);
+        double norm2 = 0.0;
+        for (const auto& [term, tf] : vec) {
+            const double w = tf * idx.idf(term);
+            norm2 += w * w;
+        }
+        if (norm2 <= 0.0) continue;
+        const float inv = (float)(1.0 / std::sqrt(norm2));
+        for (const auto& [term, tf] : vec) centroid[term] += (float)tf * idx.idf(term) * inv;
+    }
+
+    std::vector<WeightedTerm> out;
+    for (const auto& q : query) {
+        auto it = centroid.find(q.term);
+        float w = p.alpha * q.weight;
+        if (it != centroid.end() && r > 0) {
+            w += p.beta * it->second / (float)r;
+            centroid.erase(it);
+        }
+        out.push_back({q.term, w});
+    }
+
+    std::vector<WeightedTerm> extra;
+    for (const auto& [term, w] : centroid) {
+        if (r > 0) extra.push_back({term, p.beta * w / (float)r});
+    }
+    const size_t n = std::min(p.expansion, extra.size());
+    std::partial_sort(extra.begin(), extra.begin() + n, extra.end(), [](const WeightedTerm& a, const WeightedTerm& b) {
+        return a.weight != b.weight ? a.weight > b.weight : a.term < b.term;
+    });
+    out.insert(out.end(), extra.begin(), extra.begin() + n);
+    return out;
+}
@@ -0,0 +1,223 @@
+#pragma once
+
+// Второе представление списков для ранжирования: постинги, упорядоченные по
+// вкладу (impact), и вычисление "по оценкам" (score-at-a-time, как в JASS).
+// Вклад BM25 постинга idf * bm25_tf квантуется в 8 бит: q = round(score / scale),
+// 1..255, где scale = (наибольший вклад в индексе) / 255. Постинги терма
+// сгруппированы в сегменты с одинаковым q, сегменты - по убыванию q.
+//
+// data/impact_index.bin (пишет indexer --impacts):
+//   "IMP1", uint32 num_docs, uint32 num_terms, float scale, uint64 смещение каталога
+//   данные термов: varint число сегментов, для каждого сегмента
+//     uint8 q, varint n, n x varint разностей doc (по возрастанию)
+//   каталог: (num_terms + 1) x uint64 смещений данных терма от начала файла
+// id термов - те же, что в основном словаре.
+//
+// SaatEvaluator собирает сегменты всех термов запроса, проходит их по убыванию
+// q * вес терма и прибавляет вклады в массив аккумуляторов. Бюджет - число
+// обработанных постингов: обход прерывается перед сегментом, который бюджет
+// превысил бы (anytime), поэтому работа на запрос ограничена сверху, а
+// прерванный запрос уже обработал самые весомые постинги.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "index_format.h"
+#include "mmap_file.h"
+#include "postings.h"
+#include "topk.h"
+
+static constexpr char kImpactMagic[4] = {'I', 'M', 'P', '1'};
+static constexpr uint32_t kImpactLevels = 255;
+
+struct ImpactHeader {
+    char magic[4];
+    uint32_t num_docs;
+    uint32_t num_terms;
+    float scale;
+    uint64_t dir_offset;
+};
+static_assert(sizeof(ImpactHeader) == 24, "ImpactHeader layout");
+
+// Пишет термы по одному, в порядке id; каталог - в finish().
+class ImpactIndexWriter {
+public:
+    bool open(const std::string& filename, uint32_t num_docs, float max_score) {
+        out_.open(filename, std::ios::binary);
+        if (!out_) return false;
+        std::memcpy(h_.magic, kImpactMagic, sizeof(kImpactMagic));
+        h_.num_docs = num_docs;
+        h_.scale = max_score > 0.0f ? max_score / kImpactLevels : 1.0f;
+        out_.write(reinterpret_cast<const char*>(&h_), sizeof(h_));
+        offsets_.assign(1, sizeof(h_));
+        return (bool)out_;
+    }
+
+    float scale() const { return h_.scale; }
+
+    // docs - по возрастанию, scores[i] - вклад BM25 постинга docs[i].
+    void add_term(const std::vector<uint32_t>& docs, const std::vector<float>& scores) {
+        order_.clear();
+        for (size_t i = 0; i < docs.size(); i++) order_.emplace_back((uint8_t)quantize_score(scores[i], h_.scale, kImpactLevels), docs[i]);
+        std::sort(order_.begin(), order_.end(), [](const auto& a, const auto& b) {
+            return a.first != b.first ? a.first > b.first : a.second < b.second;
+        });
+        buf_.clear();
+        uint32_t segments = 0;
+        for (size_t i = 0; i < order_.size(); segments++) {
+            size_t j = i;
+            while (j < order_.size() && order_[j].first == order_[i].first) j++;
+            i = j;
+        }
+        put_varint32(buf_, segments);
+        for (size_t i = 0; i < order_.size();) {
+            size_t j = i;
+            while (j < order_.size() && order_[j].first == order_[i].first) j++;
+            buf_.push_back((char)order_[i].first);
+            put_varint32(buf_, (uint32_t)(j - i));
+            uint32_t prev = 0;
+            for (size_t p = i; p < j; p++) {
+                put_varint32(buf_, order_[p].second - prev);
+                prev = order_[p].second;
+            }
+            i = j;
+        }
+        out_.write(buf_.data(), buf_.size());
+        offsets_.push_back(offsets_.back() + buf_.size());
+        postings_ += docs.size();
+    }
+
+    bool finish() {
+        h_.num_terms = (uint32_t)offsets_.size() - 1;
+        h_.dir_offset = offsets_.back();
+        out_.write(reinterpret_cast<const char*>(offsets_.data()), offsets_.size() * sizeof(uint64_t));
+        out_.seekp(0);
+        out_.write(reinterpret_cast<const char*>(&h_), sizeof(h_));
+        out_.close();
+        return !out_.fail();
+    }
+
+    uint64_t bytes() const { return offsets_.back() + offsets_.size() * sizeof(uint64_t); }
+    uint64_t postings() const { return postings_; }
+
+private:
+    std::ofstream out_;
+    ImpactHeader h_{};
+    std::vector<uint64_t> offsets_;
+    std::vector<std::pair<uint8_t, uint32_t>> order_;
+    std::string buf_;
+    uint64_t postings_ = 0;
+};
+
+struct ImpactSegment {
+    const uint8_t* data;  // начало разностей doc
+    uint32_t count;
+    uint32_t impact;      // q * вес терма
+};
+
+class ImpactIndex {
+public:
+    bool open(const std::string& path) {
+        if (!file_.open(path, false) || file_.size() < sizeof(ImpactHeader)) return false;
+        std::memcpy(&h_, file_.data(), sizeof(h_));
+        if (std::memcmp(h_.magic, kImpactMagic, sizeof(kImpactMagic)) != 0) return false;
+        if (h_.dir_offset + ((uint64_t)h_.num_terms + 1) * sizeof(uint64_t) > file_.size()) return false;
+        dir_ = file_.data() + h_.dir_offset;
+        return true;
+    }
+
+    bool is_open() const { return dir_ != nullptr; }
+    uint32_t num_docs() const { return h_.num_docs; }
+    uint32_t num_terms() const { return h_.num_terms; }
+    float scale() const { return h_.scale; }
+
+    // Дописывает сегменты терма; weight - целый вес терма в запросе.
+    void segments(uint32_t term, uint32_t weight, std::vector<ImpactSegment>& out) const {
+        if (term >= h_.num_terms || weight == 0) return;
+        uint64_t at;
+        std::memcpy(&at, dir_ + (size_t)term * sizeof(uint64_t), sizeof(at));
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(file_.data() + at);
+        uint32_t n;
+        p = get_varint32(p, n);
+        for (uint32_t s = 0; s < n; s++) {
+            const uint32_t q = *p++;
+            uint32_t count;
+            p = get_varint32(p, count);
+            out.push_back({p, count, q * weight});
+            p = skip_varints(p, count);
+        }
+    }
+
+private:
+    MappedFile file_;
+    ImpactHeader h_{};
+    const char* dir_ = nullptr;
+};
+
+struct SaatStats {
+    uint64_t postings = 0;    // обработано постингов
+    uint64_t segments = 0;
+    bool truncated = false;   // обход прерван бюджетом
+};
+
+// Аккумуляторы выделяются один раз на все запросы; после запроса обнуляются
+// только затронутые документы.
+class SaatEvaluator {
+public:
+    explicit SaatEvaluator(const ImpactIndex& idx) : idx_(idx), acc_(idx.num_docs(), 0) {}
+
+    // weight терма округляется до целого (не меньше 1); budget - предел
+    // обработанных постингов, 0 - без предела.
+    std::vector<ScoredDoc> topk(const std::vector<WeightedTerm>& terms, size_t k, uint64_t budget,
+                                SaatStats* stats = nullptr, const StaticPrior& prior = StaticPrior()) {
+        segs_.clear();
+        for (const auto& t : terms) {
+            if (t.weight <= 0.0f) continue;
+            idx_.segments(t.term, (uint32_t)std::max(1.0f, std::round(t.weight)), segs_);
+        }
+        std::stable_sort(segs_.begin(), segs_.end(), [](const ImpactSegment& a, const ImpactSegment& b) {
+            return a.impact > b.impact;
+        });
+
+        uint64_t processed = 0;
+        for (const auto& s : segs_) {
+            if (budget && processed + s.count > budget && processed > 0) {
+                if (stats) stats->truncated = true;
+                break;
+            }
+            const uint8_t* p = s.data;
+            uint32_t doc = 0;
+            for (uint32_t i = 0; i < s.count; i++) {
+                uint32_t gap;
+                p = get_varint32(p, gap);
+                doc += gap;
+                if (acc_[doc] == 0) touched_.push_back(doc);
+                acc_[doc] += s.impact;
+            }
+            processed += s.count;
+            if (stats) stats->segments++;
+        }
+        if (stats) stats->postings += processed;
+
+        TopKHeap heap(k);
+        const float scale = idx_.scale();
+        for (uint32_t d : touched_) {
+            heap.push(d, (float)acc_[d] * scale + prior.at(d));
+            acc_[d] = 0;
+        }
+        touched_.clear();
+        return heap.take();
+    }
+
+private:
+    const ImpactIndex& idx_;
+    std::vector<uint32_t> acc_;
+    std::vector<uint32_t> touched_;
+    std::vector<ImpactSegment> segs_;
+};
@@ -0,0 +1,416 @@
+#pragma once
+
+// Формат индекса и чтение его через mmap.
+//
+// data/inverted_index.bin:
+//   IndexHeader
+//   длины документов: uint32 x num_docs
+//   с флагом kIndexHasStaticRank - статический ранг: float x num_docs
+//   (static_rank.h), документы пронумерованы по его убыванию
+//   списки словопозиций (postings.h), по одному на терм; с флагом
+//   kIndexHasPositions в списках хранятся позиции токенов
+//   с флагом kIndexHasImpacts у каждого постинга есть квантованный вклад
+//   BM25 (impact_bits = 8 или 16 бит): вклад = q * impact_scale, где шаг
+//   impact_scale = (наибольший вклад в индексе) / (2^impact_bits - 1);
+//   ранжирование складывает q * вес вместо формулы BM25 по tf
+//   словарь, термы отсортированы, id терма = номер в словаре:
+//     uint16 len, терм, uint32 df, uint64 смещение списка, uint32 размер списка, float max_score,
+//     uint8 флаги терма; биты 2..4 флагов - кодек секций doc списка
+//     (PostingCodec в postings.h), выбранный индексатором для этого терма
+//   Терм плотного яруса (kTermDense, df не меньше заданной доли документов)
+//   после списка хранит битовую карту документов: (num_docs + 7) / 8 байт,
+//   бит d - в байте d / 8. С kTermNoPositions позиций в списке терма нет.
+//   с флагом kIndexHasBloom за словарем - фильтр Блума по термам (bloom.h),
+//   поиск отсутствующего терма заканчивается на нем
+// data/forward_index.bin (прямой индекс векторов документов):
+//   "FWD1", uint32 num_docs, uint64 x (num_docs + 1) смещений,
+//   для каждого документа: varint n, n x (varint разность id терма, varint tf)
+// data/numeric_index.bin: числа из текста (numeric_index.h).
+// data/title_index.bin: индекс того же формата по словам заголовков
+// (для признаков переранжирования).
+// data/biword_index.bin: индекс того же формата по частым парам соседних
+// стемов (biword.h), для фразовых запросов.
+// data/translit_index.bin: латинские термы по ключу транслитерации (translit_index.h).
+// data/synonyms.bin: синонимы, разрешенные в id термов (synonyms.h).
+// data/term_hash.bin: минимальная совершенная хеш-функция терм -> id (mphf.h).
+// data/direct_index.bin: заголовок, ссылка, doc_id и источник каждого документа
+// (uint64 длина + байты), номер записи = внутренний номер документа.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "bitmap.h"
+#include "bloom.h"
+#include "mmap_file.h"
+#include "mphf.h"
+#include "numeric_index.h"
+#include "postings.h"
+#include "static_tree.h"
+#include "synonyms.h"
+#include "text_ru.h"
+#include "translit_index.h"
+
+static constexpr char kIndexMagic[4] = {'I', 'N', 'V', '2'};
+static constexpr char kForwardMagic[4] = {'F', 'W', 'D', '1'};
+static constexpr uint32_t kIndexVersion = 5;
+static constexpr uint32_t kIndexHasPositions = 1u << 0;
+static constexpr uint32_t kIndexHasStaticRank = 1u << 1;
+static constexpr uint32_t kIndexHasImpacts = 1u << 2;
+static constexpr uint32_t kIndexHasBloom = 1u << 3;
+static constexpr uint8_t kTermDense = 1u << 0;
+static constexpr uint8_t kTermNoPositions = 1u << 1;
+static constexpr uint32_t kTermCodecShift = 2;
+static constexpr uint8_t kTermCodecMask = 7u << kTermCodecShift;
+
+struct IndexHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t num_docs;
+    uint32_t num_terms;
+    uint64_t total_postings;
+    uint64_t total_doc_len;
+    uint64_t doclen_offset;
+    uint64_t postings_offset;
+    uint64_t postings_bytes;
+    uint64_t dict_offset;
+    uint64_t dict_bytes;
+    float bm25_k1;
+    float bm25_b;
+    uint32_t flags;
+    float impact_scale;    // параметры квантования вкладов (kIndexHasImpacts)
+    uint32_t impact_bits;
+    uint32_t reserved;
+};
+static_assert(sizeof(IndexHeader) == 96, "IndexHeader layout");
+
+struct DirectIndex {
+    std::string doc_id;
+    std::string title;
+    std::string url;
+    std::string source;
+};
+
+struct TermInfo {
+    uint32_t df = 0;
+    uint64_t offset = 0;
+    uint32_t bytes = 0;
+    float max_score = 0.0f;  // верхняя граница вклада BM25 терма в оценку документа (для WAND)
+    uint8_t flags = 0;       // kTermDense, kTermNoPositions, кодек (kTermCodecMask)
+};
+
+// Проверки фильтра Блума в IndexReader::lookup.
+struct BloomStats {
+    uint64_t lookups = 0;           // проверок фильтра
+    uint64_t rejected = 0;          // терма нет по фильтру - словарь не смотрели
+    uint64_t false_positives = 0;   // фильтр пропустил, а в словаре терма нет
+
+    // Доля ложных срабатываний среди отсутствующих термов.
+    double fpr() const {
+        const uint64_t absent = rejected + false_positives;
+        return absent ? (double)false_positives / absent : 0.0;
+    }
+};
+
+inline float bm25_idf(uint32_t num_docs, uint32_t df) {
+    return (float)std::log(1.0 + ((double)num_docs - df + 0.5) / ((double)df + 0.5));
+}
+
+// norm = k1 * (1 - b + b * dl / avgdl), считается один раз на документ.
+inline float bm25_norm(uint32_t dl, double avgdl, float k1, float b) {
+    return (float)(k1 * (1.0 - b + b * (avgdl > 0.0 ? dl / avgdl : 0.0)));
+}
+
+inline float bm25_tf(uint32_t tf, float norm, float k1) {
+    return (float)tf * (k1 + 1.0f) / ((float)tf + norm);
+}
+
+// Квантование вклада с шагом scale в 1..levels (ненулевой вклад не обнуляется).
+inline uint32_t quantize_score(float score, float scale, uint32_t levels) {
+    const float q = std::round(score / scale);
+    return (uint32_t)std::clamp(q, 1.0f, (float)levels);
+}
+
+inline void write_direct_index(const std::vector<DirectIndex>& direct_index, const std::string& filename) {
+    std::ofstream out(filename, std::ios::binary);
+    for (const auto& doc : direct_index) {
+        for (const std::string* s : {&doc.title, &doc.url, &doc.doc_id, &doc.source}) {
+            uint64_t size = s->size();
+            out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+            out.write(s->data(), size);
+        }
+    }
+}
+
+inline bool load_direct_index(const std::string& filename, std::vector<DirectIndex>& direct_index) {
+    std::ifstream infile(filename, std::ios::binary);
+    if (!infile) return false;
+
+    for (;;) {
+        DirectIndex doc;
+        bool ok = true;
+        for (std::string* s : {&doc.title, &doc.url, &doc.doc_id, &doc.source}) {
+            uint64_t size = 0;
+            infile.read(reinterpret_cast<char*>(&size), sizeof(size));
+            if (!infile) { ok = false; break; }
+            s->resize(size);
+            infile.read(&(*s)[0], size);
+        }
+        if (!ok) break;
+        direct_index.push_back(std::move(doc));
+    }
+    return true;
+}
+
+// Прямой индекс: вектор (id терма, tf) документа, отсортированный по id.
+inline void encode_forward(const std::vector<std::pair<uint32_t, uint32_t>>& vec, std::string& out) {
+    put_varint32(out, (uint32_t)vec.size());
+    uint32_t prev = 0;
+    for (const auto& [term, tf] : vec) {
+        put_varint32(out, term - prev);
+        put_varint32(out, tf);
+        prev = term;
+    }
+}
+
+class IndexReader {
+public:
+    bool open(const std::string& dir) {
+        if (!open_file(dir + "/inverted_index.bin")) return false;
+
+        // Прямой индекс необязателен: без него не работает только поиск похожих.
+        if (fwd_.open(dir + "/forward_index.bin", false) && fwd_.size() >= 8 &&
+            std::memcmp(fwd_.data(), kForwardMagic, sizeof(kForwardMagic)) == 0) {
+            fwd_offsets_ = fwd_.data() + 8;
+            fwd_data_ = fwd_offsets_ + ((size_t)h_.num_docs + 1) * sizeof(uint64_t);
+        }
+        // Числовой индекс тоже необязателен: без него range:[..] ничего не находит.
+        numeric_.open(dir + "/numeric_index.bin");
+        translit_.open(dir + "/translit_index.bin");
+        synonyms_.open(dir + "/synonyms.bin");
+        // Без хеш-функции термы ищутся двоичным поиском по словарю.
+        if (!term_hash_.open(dir + "/term_hash.bin") || term_hash_.size() != h_.num_terms) term_hash_ = TermHash();
+        // Индекс биграмм (biword.h) только ускоряет фразы.
+        auto biwords = std::make_unique<IndexReader>();
+        if (biwords->open_file(dir + "/biword_index.bin") && biwords->num_docs() == h_.num_docs) {
+            biwords_ = std::move(biwords);
+        }
+        return true;
+    }
+
+    // Только файл обратного индекса (например, title_index.bin).
+    bool open_file(const std::string& path) {
+        if (!inv_.open(path, false)) return false;
+        if (inv_.size() < sizeof(IndexHeader)) return false;
+        std::memcpy(&h_, inv_.data(), sizeof(h_));
+        if (std::memcmp(h_.magic, kIndexMagic, sizeof(kIndexMagic)) != 0 || h_.version != kIndexVersion) return false;
+        if (has_impacts() && h_.impact_bits != 8 && h_.impact_bits != 16) return false;
+
+        avgdl_ = h_.num_docs ? (double)h_.total_doc_len / h_.num_docs : 0.0;
+        doc_len_.resize(h_.num_docs);
+        std::memcpy(doc_len_.data(), inv_.data() + h_.doclen_offset, (size_t)h_.num_docs * sizeof(uint32_t));
+        doc_norm_.resize(h_.num_docs);
+        for (uint32_t d = 0; d < h_.num_docs; d++) {
+            doc_norm_[d] = bm25_norm(doc_len_[d], avgdl_, h_.bm25_k1, h_.bm25_b);
+        }
+        static_rank_.clear();
+        if (h_.flags & kIndexHasStaticRank) {
+            static_rank_.resize(h_.num_docs);
+            std::memcpy(static_rank_.data(), inv_.data() + h_.doclen_offset + (size_t)h_.num_docs * sizeof(uint32_t),
+                        (size_t)h_.num_docs * sizeof(float));
+        }
+
+        terms_.resize(h_.num_terms);
+        term_text_.resize(h_.num_terms);
+        const char* p = inv_.data() + h_.dict_offset;
+        for (uint32_t t = 0; t < h_.num_terms; t++) {
+            uint16_t len;
+            std::memcpy(&len, p, sizeof(len));
+            p += sizeof(len);
+            term_text_[t] = std::string_view(p, len);
+            p += len;
+            TermInfo& ti = terms_[t];
+            std::memcpy(&ti.df, p, sizeof(ti.df)); p += sizeof(ti.df);
+            std::memcpy(&ti.offset, p, sizeof(ti.offset)); p += sizeof(ti.offset);
+            std::memcpy(&ti.bytes, p, sizeof(ti.bytes)); p += sizeof(ti.bytes);
+            std::memcpy(&ti.max_score, p, sizeof(ti.max_score)); p += sizeof(ti.max_score);
+            ti.flags = (uint8_t)*p++;
+            if (((ti.flags & kTermCodecMask) >> kTermCodecShift) >= kNumCodecs) return false;
+        }
+        dict_heads_.clear();
+        for (uint32_t t = 0; t < h_.num_terms; t += kDictBlock) dict_heads_.push_back(key_prefix(term_text_[t]));
+        dict_tree_.build(dict_heads_.data(), dict_heads_.size());
+
+        // Фильтр копируется в память: он нужен на каждый поиск терма.
+        bloom_ = BloomFilter();
+        if (h_.flags & kIndexHasBloom) {
+            const uint64_t at = h_.dict_offset + h_.dict_bytes;
+            if (at > inv_.size() || !bloom_.load(inv_.data() + at, inv_.size() - at)) return false;
+        }
+        bloom_stats_ = BloomStats();
+        return true;
+    }
+
+    const IndexHeader& header() const { return h_; }
+    uint32_t num_docs() const { return h_.num_docs; }
+    uint32_t num_terms() const { return h_.num_terms; }
+    double avg_doc_len() const { return avgdl_; }
+    float k1() const { return h_.bm25_k1; }
+    bool has_positions() const { return (h_.flags & kIndexHasPositions) != 0; }
+    bool has_impacts() const { return (h_.flags & kIndexHasImpacts) != 0; }
+    uint32_t doc_len(uint32_t d) const { return doc_len_[d]; }
+    float doc_norm(uint32_t d) const { return doc_norm_[d]; }
+    // Ранг в [0, 1], не возрастает с номером документа; nullptr - ранга нет.
+    const float* static_rank() const { return static_rank_.empty() ? nullptr : static_rank_.data(); }
+
+    // Отсутствующий терм обычно отсекает фильтр Блума. Иначе хеш-функция
+    // дает единственного кандидата, он сверяется со строкой словаря; без
+    // нее - поиск по порядку. -1, если терма нет.
+    int64_t lookup(std::string_view term) const {
+        const uint64_t h = hash_token(term);
+        if (!bloom_.empty()) {
+            bloom_stats_.lookups++;
+            if (!bloom_.may_contain(h)) {
+                bloom_stats_.rejected++;
+                return -1;
+            }
+        }
+        int64_t id = -1;
+        if (term_hash_.is_open()) {
+            id = term_hash_.candidate(h);
+            if (id >= 0 && term_text_[id] != term) id = -1;
+        } else {
+            const uint32_t at = term_lower_bound(term);
+            if (at < h_.num_terms && term_text_[at] == term) id = at;
+        }
+        if (id < 0 && !bloom_.empty()) bloom_stats_.false_positives++;
+        return id;
+    }
+
+    // Первый id терма, не меньший term (num_terms(), если такого нет).
+    // Блок словаря находится по дереву над 8-байтными префиксами первых
+    // термов блоков (static_tree.h), внутри - двоичный поиск по строкам.
+    uint32_t term_lower_bound(std::string_view term) const {
+        const uint64_t key = key_prefix(term);
+        // Блоки до first - 1 целиком меньше term, блоки с префиксом больше
+        // key - целиком больше; оба края - спуском по дереву.
+        const size_t first = dict_tree_.lower_bound(key);
+        const size_t last = key == UINT64_MAX ? dict_heads_.size() : dict_tree_.lower_bound(key + 1);
+        const size_t from = first ? (first - 1) * kDictBlock : 0;
+        const size_t to = std::min<size_t>(last * kDictBlock, h_.num_terms);
+        return (uint32_t)(std::lower_bound(term_text_.begin() + from, term_text_.begin() + to, term) - term_text_.begin());
+    }
+
+    // Терм и его формы в другой письменности ("drosophila" / "дрозофила"):
+    // сам терм, кириллический терм с ключом транслитерации и латинские термы
+    // с тем же ключом из второго пространства. Ключ считается один раз, без
+    // просмотра словаря; ids - по возрастанию, без повторов.
+    void lookup_variants(std::string_view term, std::vector<uint32_t>& ids) const {
+        ids.clear();
+        const int64_t id = lookup(term);
+        if (id >= 0) ids.push_back((uint32_t)id);
+        if (!translit_.is_open()) return;
+        std::string key(term);
+        try {
+            const std::wstring wkey = translit_key(utf8_to_wstring(term));
+            if (!wkey.empty()) {
+                key = wstring_to_utf8(wkey);
+                const int64_t cyr = lookup(key);
+                if (cyr >= 0) ids.push_back((uint32_t)cyr);
+            }
+        } catch (...) {
+            return;
+        }
+        translit_.lookup(key, ids);
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    }
+
+    const TermInfo& term(uint32_t id) const { return terms_[id]; }
+    std::string_view term_text(uint32_t id) const { return term_text_[id]; }
+    float idf(uint32_t id) const { return bm25_idf(h_.num_docs, terms_[id].df); }
+
+    // Оценка документа по терму = posting_weight(терм) * posting_score(постинг):
+    // idf * BM25 по tf или шаг квантования * вклад, если вклады есть в индексе.
+    float posting_weight(uint32_t id) const { return has_impacts() ? h_.impact_scale : idf(id); }
+
+    template <typename It>
+    float posting_score(const It& it, float norm) const {
+        return has_impacts() ? (float)it.impact() : bm25_tf(it.tf(), norm, h_.bm25_k1);
+    }
+
+    PostingIterator postings(uint32_t id) const {
+        const TermInfo& ti = terms_[id];
+        return PostingIterator(inv_.data() + h_.postings_offset + ti.offset, ti.df,
+                               has_positions() && !(ti.flags & kTermNoPositions),
+                               has_impacts() ? h_.impact_bits / 8 : 0, codec(id));
+    }
+
+    bool dense(uint32_t id) const { return (terms_[id].flags & kTermDense) != 0; }
+    PostingCodec codec(uint32_t id) const { return (PostingCodec)((terms_[id].flags & kTermCodecMask) >> kTermCodecShift); }
+
+    // Битовая карта терма плотного яруса - последние байты его списка.
+    DocBitmapView dense_bitmap(uint32_t id) const {
+        const TermInfo& ti = terms_[id];
+        const size_t bytes = ((size_t)h_.num_docs + 7) / 8;
+        const char* end = inv_.data() + h_.postings_offset + ti.offset + ti.bytes;
+        return DocBitmapView(reinterpret_cast<const uint8_t*>(end - bytes), h_.num_docs);
+    }
+
+    bool has_forward() const { return fwd_offsets_ != nullptr; }
+    const NumericIndex& numeric() const { return numeric_; }
+    const IndexReader* biwords() const { return biwords_.get(); }
+    const SynonymIndex& synonyms() const { return synonyms_; }
+    const TermHash& term_hash() const { return term_hash_; }
+    const BloomFilter& bloom() const { return bloom_; }
+    const BloomStats& bloom_stats() const { return bloom_stats_; }
+
+    // Вектор документа читается одним непрерывным куском.
+    void forward(uint32_t doc, std::vector<std::pair<uint32_t, uint32_t>>& out) const {
+        out.clear();
+        if (!fwd_offsets_ || doc >= h_.num_docs) return;
+        uint64_t from;
+        std::memcpy(&from, fwd_offsets_ + (size_t)doc * sizeof(uint64_t), sizeof(from));
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(fwd_data_ + from);
+        uint32_t n, term = 0;
+        p = get_varint32(p, n);
+        out.reserve(n);
+        for (uint32_t i = 0; i < n; i++) {
+            uint32_t gap, tf;
+            p = get_varint32(p, gap);
+            p = get_varint32(p, tf);
+            term += gap;
+            out.emplace_back(term, tf);
+        }
+    }
+
+private:
+    MappedFile inv_;
+    MappedFile fwd_;
+    NumericIndex numeric_;
+    TranslitIndex translit_;
+    SynonymIndex synonyms_;
+    TermHash term_hash_;
+    std::unique_ptr<IndexReader> biwords_;
+    IndexHeader h_{};
+    double avgdl_ = 0.0;
+    std::vector<uint32_t> doc_len_;
+    std::vector<float> doc_norm_;
+    std::vector<float> static_rank_;
+    std::vector<TermInfo> terms_;
+    std::vector<std::string_view> term_text_;
+    static constexpr uint32_t kDictBlock = 16;
+    std::vector<uint64_t> dict_heads_;   // key_prefix первых термов блоков
+    EytzingerTree dict_tree_;
+    BloomFilter bloom_;
+    mutable BloomStats bloom_stats_;
+    const char* fwd_offsets_ = nullptr;
+    const char* fwd_data_ = nullptr;
+};
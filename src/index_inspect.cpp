@@ -0,0 +1,211 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <iomanip>
+#include <filesystem>
+
+#include "index_format.h"
+#include "metrics.h"
+
+// Осмотр индекса: куда уходят байты. Файл обратного индекса открывается
+// через mmap (IndexReader::open_file), разбираются только заголовок и
+// словарь, сами списки не читаются - отчет по большому индексу занимает
+// секунды. Печатаются размеры файлов каталога и секций файла, гистограмма
+// df с битами на постинг по полосам df, разбивка по кодекам, термы с самыми
+// большими списками и размер словаря; --term выводит список одного терма.
+// Размеры пишутся в метрики (data/metrics/index_inspect.json), чтобы
+// следить за ростом индекса от сборки к сборке.
+
+namespace fs = std::filesystem;
+
+struct InspectOptions {
+    std::string index_dir = "data";
+    std::string file = "inverted_index.bin";   // title_index.bin, biword_index.bin
+    size_t top = 20;
+    std::string term;
+    size_t limit = 20;   // постингов в выводе --term, 0 - все
+};
+
+// Размер списка терма и бит на постинг; в размер входят tf, позиции,
+// вклады и битовая карта плотного яруса.
+struct Band {
+    uint64_t terms = 0;
+    uint64_t postings = 0;
+    uint64_t bytes = 0;
+    void add(uint32_t df, uint64_t b) { terms++; postings += df; bytes += b; }
+    double bits_per_posting() const { return postings ? 8.0 * bytes / postings : 0.0; }
+};
+
+// Выравнивание по символам UTF-8: std::setw считает байты.
+static std::string pad(const std::string& s, size_t width) {
+    size_t chars = 0;
+    for (unsigned char c : s) chars += (c & 0xC0) != 0x80;
+    return chars < width ? std::string(width - chars, ' ') + s : s;
+}
+
+static void print_band(const std::string& name, const Band& b) {
+    std::cout << "  " << std::left << std::setw(16) << name << std::right << std::setw(10) << b.terms << std::setw(12)
+              << b.postings << std::setw(14) << b.bytes << std::setw(10) << b.bits_per_posting() << std::endl;
+}
+
+static int dump_term(const IndexReader& index, const InspectOptions& opt) {
+    // Сначала терм как в словаре, затем нормализованный как слово запроса.
+    int64_t id = index.lookup(opt.term);
+    if (id < 0) {
+        const std::vector<std::string> words = normalize_query_text(opt.term);
+        if (words.size() == 1) id = index.lookup(words[0]);
+    }
+    if (id < 0) {
+        std::cerr << "Терма '" << opt.term << "' нет в словаре " << opt.file << std::endl;
+        return 1;
+    }
+    const TermInfo& ti = index.term((uint32_t)id);
+    std::cout << "Терм '" << index.term_text((uint32_t)id) << "': id " << id << ", df " << ti.df << ", список " << ti.bytes
+              << " байт (" << 8.0 * ti.bytes / std::max(1u, ti.df) << " бит на постинг), кодек "
+              << codec_name(index.codec((uint32_t)id)) << (index.dense((uint32_t)id) ? ", плотный ярус" : "")
+              << ", max_score " << ti.max_score << std::endl;
+
+    std::vector<DirectIndex> direct_index;
+    load_direct_index(opt.index_dir + "/direct_index.bin", direct_index);
+    PostingIterator it = index.postings((uint32_t)id);
+    std::vector<uint32_t> positions;
+    size_t shown = 0;
+    for (; !it.at_end() && (opt.limit == 0 || shown < opt.limit); it.next(), shown++) {
+        const uint32_t d = it.doc();
+        std::cout << d << '\t' << (d < direct_index.size() ? direct_index[d].doc_id : "-") << "\ttf " << it.tf();
+        if (index.has_impacts()) std::cout << "\tвклад " << it.impact();
+        it.positions(positions);
+        if (!positions.empty()) {
+            std::cout << "\tпозиции";
+            for (uint32_t p : positions) std::cout << ' ' << p;
+        }
+        std::cout << std::endl;
+    }
+    if (shown < ti.df) std::cout << "... еще " << ti.df - shown << " постингов (--limit 0 - все)" << std::endl;
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    InspectOptions opt;
+    for (int i = 1; i < argc; i++) {
+        const std::string a = argv[i];
+        if (a == "--index" && i + 1 < argc) opt.index_dir = argv[++i];
+        else if (a == "--file" && i + 1 < argc) opt.file = argv[++i];
+        else if (a == "--top" && i + 1 < argc) opt.top = std::stoul(argv[++i]);
+        else if (a == "--term" && i + 1 < argc) opt.term = argv[++i];
+        else if (a == "--limit" && i + 1 < argc) opt.limit = std::stoul(argv[++i]);
+        else {
+            std::cerr << "Использование: index_inspect [--index dir] [--file inverted_index.bin] [--top N]"
+                      << " [--term T [--limit N]]" << std::endl;
+            return 1;
+        }
+    }
+
+    metrics::Timer timer;
+    const std::string path = opt.index_dir + "/" + opt.file;
+    IndexReader index;
+    if (!index.open_file(path)) {
+        std::cerr << "Не удалось открыть индекс " << path << std::endl;
+        return 1;
+    }
+    if (!opt.term.empty()) return dump_term(index, opt);
+
+    metrics::Registry reg("index_inspect");
+    std::cout << std::fixed << std::setprecision(2);
+
+    // Все файлы каталога индекса, по убыванию размера.
+    std::vector<std::pair<uint64_t, std::string>> files;
+    std::error_code ec;
+    for (const auto& e : fs::directory_iterator(opt.index_dir, ec)) {
+        if (e.is_regular_file() && e.path().extension() == ".bin") files.emplace_back(e.file_size(), e.path().filename().string());
+    }
+    std::sort(files.rbegin(), files.rend());
+    uint64_t total_bytes = 0;
+    for (const auto& f : files) total_bytes += f.first;
+    std::cout << "Файлы " << opt.index_dir << " (" << total_bytes << " байт):" << std::endl;
+    for (const auto& [bytes, name] : files) {
+        std::cout << "  " << std::left << std::setw(24) << name << std::right << std::setw(14) << bytes << std::setw(8)
+                  << (total_bytes ? 100.0 * bytes / total_bytes : 0.0) << "%" << std::endl;
+        reg.gauge("file_bytes_" + fs::path(name).stem().string(), "Размер файла индекса, байт").set((double)bytes);
+    }
+    reg.gauge("index_bytes", "Размер всех файлов индекса, байт").set((double)total_bytes);
+
+    // Секции файла в порядке записи (index_format.h).
+    const IndexHeader& h = index.header();
+    const uint64_t file_bytes = fs::file_size(path, ec);
+    const uint64_t doclen_bytes = (uint64_t)h.num_docs * sizeof(uint32_t);
+    const uint64_t rank_bytes = index.static_rank() ? (uint64_t)h.num_docs * sizeof(float) : 0;
+    const uint64_t bloom_bytes = index.bloom().empty() ? 0 : index.bloom().bytes();
+    const uint64_t bitmap_bytes_per_term = ((uint64_t)h.num_docs + 7) / 8;
+    Band all, dense;
+    for (uint32_t id = 0; id < h.num_terms; id++) {
+        all.add(index.term(id).df, index.term(id).bytes);
+        if (index.dense(id)) dense.add(index.term(id).df, bitmap_bytes_per_term);
+    }
+    const std::pair<const char*, uint64_t> sections[] = {
+        {"header", sizeof(IndexHeader)}, {"doc_lengths", doclen_bytes}, {"static_rank", rank_bytes},
+        {"postings", h.postings_bytes},  {"dictionary", h.dict_bytes},  {"bloom", bloom_bytes},
+    };
+    std::cout << std::endl << "Секции " << opt.file << " (" << file_bytes << " байт):" << std::endl;
+    for (const auto& [name, bytes] : sections) {
+        std::cout << "  " << std::left << std::setw(24) << name << std::right << std::setw(14) << bytes << std::setw(8)
+                  << (file_bytes ? 100.0 * bytes / file_bytes : 0.0) << "%" << std::endl;
+        reg.gauge(std::string("section_bytes_") + name, "Размер секции файла индекса, байт").set((double)bytes);
+    }
+    if (dense.terms) {
+        std::cout << "  из них битовые карты плотного яруса: " << dense.bytes << " байт, " << dense.terms << " термов"
+                  << std::endl;
+    }
+
+    std::cout << std::endl << "Словарь: " << h.num_terms << " термов, " << all.postings << " постингов, " << h.num_docs
+              << " документов, " << (h.num_terms ? 8.0 * h.dict_bytes / h.num_terms : 0.0) << " бит словаря на терм"
+              << std::endl;
+    reg.gauge("vocabulary_terms", "Термов в словаре").set((double)h.num_terms);
+    reg.gauge("postings", "Постингов в файле").set((double)all.postings);
+    reg.gauge("bits_per_posting", "Среднее бит на постинг в списках").set(all.bits_per_posting());
+
+    // Полосы df по степеням двойки: [1], [2, 3], [4, 7], ...
+    std::vector<Band> bands;
+    Band by_codec[kNumCodecs];
+    for (uint32_t id = 0; id < h.num_terms; id++) {
+        const TermInfo& ti = index.term(id);
+        const size_t band = ti.df ? 31 - __builtin_clz(ti.df) : 0;
+        if (bands.size() <= band) bands.resize(band + 1);
+        bands[band].add(ti.df, ti.bytes);
+        by_codec[index.codec(id)].add(ti.df, ti.bytes);
+    }
+    std::cout << std::endl << "Гистограмма df (бит на постинг - с tf, позициями и битовыми картами):" << std::endl;
+    std::cout << "  df              " << pad("термов", 10) << pad("постингов", 12) << pad("байт", 14) << pad("бит/пост", 10)
+              << std::endl;
+    for (size_t b = 0; b < bands.size(); b++) {
+        if (!bands[b].terms) continue;
+        const uint64_t lo = 1ull << b, hi = (2ull << b) - 1;
+        print_band(lo == hi ? std::to_string(lo) : std::to_string(lo) + "-" + std::to_string(hi), bands[b]);
+    }
+    std::cout << std::endl << "Кодеки списков:" << std::endl;
+    for (uint32_t c = 0; c < kNumCodecs; c++) {
+        if (by_codec[c].terms) print_band(codec_name((PostingCodec)c), by_codec[c]);
+    }
+
+    // Термы с самыми большими списками.
+    std::vector<uint32_t> ids(h.num_terms);
+    for (uint32_t id = 0; id < h.num_terms; id++) ids[id] = id;
+    const size_t top = std::min<size_t>(opt.top, ids.size());
+    std::partial_sort(ids.begin(), ids.begin() + top, ids.end(),
+                      [&](uint32_t a, uint32_t b) { return index.term(a).bytes > index.term(b).bytes; });
+    std::cout << std::endl << "Термы с самыми большими списками:" << std::endl;
+    for (size_t i = 0; i < top; i++) {
+        const TermInfo& ti = index.term(ids[i]);
+        std::cout << "  " << index.term_text(ids[i]) << "\tdf " << ti.df << "\t" << ti.bytes << " байт\t"
+                  << (all.bytes ? 100.0 * ti.bytes / all.bytes : 0.0) << "% списков\t" << codec_name(index.codec(ids[i]))
+                  << std::endl;
+    }
+
+    reg.gauge("inspect_seconds", "Время осмотра индекса, с").set(timer.seconds());
+    std::cout << std::endl << "Осмотр занял " << timer.seconds() << " с" << std::endl;
+    if (!metrics::dump_json(reg)) {
+        std::cerr << "Не удалось записать метрики в " << metrics::metrics_dir() << std::endl;
+    }
+    return 0;
+}
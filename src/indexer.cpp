@@ -2,88 +2,417 @@
 #include <fstream>
 #include <string>
 #include <vector>
-#include <cctype>
 #include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <filesystem>
 #include <json/json.h>
 #include <set>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+#include <string_view>
+#include <thread>
+
+#include <sys/resource.h>
+
+#include "biword.h"
+#include "bson_reader.h"
+#include "impact_index.h"
+#include "index_format.h"
+#include "metrics.h"
+#include "minhash.h"
+#include "numeric_index.h"
+#include "radix_sort.h"
+#include "static_rank.h"
+#include "text_ru.h"
+#include "token_stream.h"
+#include "synonyms.h"
+#include "translit_index.h"
+
+namespace fs = std::filesystem;
+
+static constexpr float kBm25K1 = 1.2f;
+static constexpr float kBm25B = 0.75f;
+
+struct TermPostings {
+    std::vector<uint32_t> docs;
+    std::vector<uint32_t> tfs;
+    std::vector<uint32_t> positions;  // по tf позиций на постинг
+};
 
-std::string to_lower(const std::string& s) {
-    std::string result = s;
-    std::transform(result.begin(), result.end(), result.begin(), ::tolower);
-    return result;
-}
+// Инвертирование в памяти: терм -> id через хеш-таблицу, списки растут по мере
+// чтения потока токенов. Для каждого документа сохраняется и его вектор
+// (id терма, tf) для прямого индекса.
+// С sort_inversion постинги не раскладываются по спискам терма на лету:
+// каждая пара (терм, документ) дописывается в общий буфер ключом
+// id терма << 32 | документ со ссылкой на tf и позиции в общем массиве, а
+// invert_runs сортирует ключи параллельной поразрядной сортировкой
+// (radix_sort.h) и за один линейный проход собирает списки.
+struct IndexBuilder {
+    std::unordered_map<std::string, uint32_t> term_ids;
+    std::vector<std::string> terms;
+    std::vector<TermPostings> postings;
+    std::vector<uint32_t> doc_len;
+    std::vector<float> static_rank;  // пусто - документы в порядке корпуса
+    uint32_t impact_bits = 0;        // 8/16 - квантованные вклады BM25 в постингах
+    int codec = -1;                  // кодек всех списков; -1 - свой для каждого списка (choose_codec)
+    double codec_lambda = 4.0;       // бит размера за наносекунду декодирования
+    double bloom_bits = 10.0;        // бит фильтра Блума на терм; 0 - без фильтра
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> forward;
+    uint64_t total_postings = 0;
+    std::string key;
+    bool sort_inversion = false;
+    std::vector<uint64_t> run_keys;
+    std::vector<uint32_t> run_vals;        // начало (tf, позиции...) постинга в run_data
+    std::vector<uint32_t> run_data;
+
+    uint32_t term_id(std::string_view term) {
+        key.assign(term.data(), term.size());
+        auto it = term_ids.find(key);
+        if (it != term_ids.end()) return it->second;
+        const uint32_t id = (uint32_t)terms.size();
+        term_ids.emplace(key, id);
+        terms.push_back(key);
+        postings.emplace_back();
+        return id;
+    }
 
-struct DirectIndex {
-    std::string doc_id;
-    std::string title;
-    std::string url;
-};
+    // seq - пары (id терма, позиция) документа; портится (сортируется).
+    // На одной позиции может быть несколько термов (составное слово и его
+    // части), поэтому длина документа - число позиций, а не пар.
+    void add_doc(uint32_t doc, std::vector<std::pair<uint32_t, uint32_t>>& seq, uint32_t length) {
+        doc_len[doc] = length;
+        std::sort(seq.begin(), seq.end());
+        auto& vec = forward[doc];
+        vec.clear();
+        for (size_t i = 0; i < seq.size();) {
+            const uint32_t term = seq[i].first;
+            size_t j = i;
+            while (j < seq.size() && seq[j].first == term) j++;
+            vec.emplace_back(term, (uint32_t)(j - i));
+            if (sort_inversion) {
+                run_keys.push_back((uint64_t)term << 32 | doc);
+                run_vals.push_back((uint32_t)run_data.size());
+                run_data.push_back((uint32_t)(j - i));
+                for (size_t k = i; k < j; k++) run_data.push_back(seq[k].second);
+            } else {
+                TermPostings& tp = postings[term];
+                for (size_t k = i; k < j; k++) tp.positions.push_back(seq[k].second);
+                tp.docs.push_back(doc);
+                tp.tfs.push_back((uint32_t)(j - i));
+            }
+            i = j;
+        }
+        total_postings += vec.size();
+    }
 
-struct InvertedIndex {
-    std::string term;
-    std::vector<std::string> doc_ids;
+    // Сортирует накопленные пары и раскладывает их по спискам термов; списки
+    // выделяются сразу нужного размера. Буферы пар освобождаются.
+    void invert_runs(unsigned threads, RadixSortStats* stats = nullptr) {
+        radix_sort_pairs(run_keys, run_vals, threads, stats);
+        std::vector<uint64_t> df(postings.size(), 0), npos(postings.size(), 0);
+        for (size_t i = 0; i < run_keys.size(); i++) {
+            const uint32_t term = (uint32_t)(run_keys[i] >> 32);
+            df[term]++;
+            npos[term] += run_data[run_vals[i]];
+        }
+        for (size_t t = 0; t < postings.size(); t++) {
+            postings[t].docs.reserve(postings[t].docs.size() + df[t]);
+            postings[t].tfs.reserve(postings[t].tfs.size() + df[t]);
+            postings[t].positions.reserve(postings[t].positions.size() + npos[t]);
+        }
+        for (size_t i = 0; i < run_keys.size(); i++) {
+            TermPostings& tp = postings[run_keys[i] >> 32];
+            const uint32_t* p = &run_data[run_vals[i]];
+            tp.docs.push_back((uint32_t)run_keys[i]);
+            tp.tfs.push_back(p[0]);
+            tp.positions.insert(tp.positions.end(), p + 1, p + 1 + p[0]);
+        }
+        run_keys = std::vector<uint64_t>();
+        run_vals = std::vector<uint32_t>();
+        run_data = std::vector<uint32_t>();
+    }
 };
 
-void write_direct_index(const std::vector<DirectIndex>& direct_index, const std::string& filename) {
-    std::ofstream out(filename, std::ios::binary);
-    if (!out) {
-        std::cerr << "Ошибка при открытии файла для записи прямого индекса!" << std::endl;
-        return;
+// Пиковый размер резидентной памяти процесса.
+static uint64_t peak_rss_bytes() {
+    struct rusage ru{};
+    getrusage(RUSAGE_SELF, &ru);
+    return (uint64_t)ru.ru_maxrss * 1024;
+}
+
+// Термы упорядочиваются лексикографически: id терма в индексе = номер в словаре.
+static std::vector<uint32_t> sorted_term_order(const std::vector<std::string>& terms) {
+    std::vector<uint32_t> order(terms.size());
+    for (uint32_t i = 0; i < order.size(); i++) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return terms[a] < terms[b]; });
+    return order;
+}
+
+// Документы приходят не по порядку только если поток токенов перемешан;
+// переставляем постинги вместе с их позициями.
+static void sort_postings(TermPostings& tp) {
+    if (std::is_sorted(tp.docs.begin(), tp.docs.end())) return;
+    std::vector<uint32_t> idx(tp.docs.size()), start(tp.docs.size());
+    for (size_t i = 0, at = 0; i < tp.docs.size(); at += tp.tfs[i], i++) {
+        idx[i] = (uint32_t)i;
+        start[i] = (uint32_t)at;
+    }
+    std::sort(idx.begin(), idx.end(), [&](uint32_t a, uint32_t b) { return tp.docs[a] < tp.docs[b]; });
+    TermPostings sorted;
+    for (uint32_t i : idx) {
+        sorted.docs.push_back(tp.docs[i]);
+        sorted.tfs.push_back(tp.tfs[i]);
+        sorted.positions.insert(sorted.positions.end(), tp.positions.begin() + start[i],
+                                tp.positions.begin() + start[i] + tp.tfs[i]);
+    }
+    tp = std::move(sorted);
+}
+
+// Списки биграмм (biword.h): пересечение позиций первого и второго терма со
+// сдвигом на 1. Строится до записи основного индекса, пока его списки в памяти.
+static void build_biwords(IndexBuilder& b, const std::vector<std::pair<uint32_t, uint32_t>>& pairs, IndexBuilder& out) {
+    out.doc_len = b.doc_len;
+    for (const auto& [first, second] : pairs) {
+        TermPostings& x = b.postings[first];
+        TermPostings& y = b.postings[second];
+        sort_postings(x);
+        sort_postings(y);
+        TermPostings res;
+        size_t i = 0, j = 0, xp = 0, yp = 0;
+        while (i < x.docs.size() && j < y.docs.size()) {
+            if (x.docs[i] < y.docs[j]) {
+                xp += x.tfs[i++];
+            } else if (x.docs[i] > y.docs[j]) {
+                yp += y.tfs[j++];
+            } else {
+                uint32_t tf = 0;
+                for (size_t a = xp, c = yp; a < xp + x.tfs[i] && c < yp + y.tfs[j];) {
+                    if (x.positions[a] + 1 < y.positions[c]) a++;
+                    else if (x.positions[a] + 1 > y.positions[c]) c++;
+                    else {
+                        res.positions.push_back(x.positions[a]);
+                        tf++;
+                        a++;
+                        c++;
+                    }
+                }
+                if (tf) {
+                    res.docs.push_back(x.docs[i]);
+                    res.tfs.push_back(tf);
+                }
+                xp += x.tfs[i++];
+                yp += y.tfs[j++];
+            }
+        }
+        if (res.docs.empty()) continue;
+        const uint32_t id = out.term_id(biword_term(b.terms[first], b.terms[second]));
+        out.total_postings += res.docs.size();
+        out.postings[id] = std::move(res);
     }
+}
+
+// Ярусы термов по df. Термы с df >= dense_df * N (вроде "это", "также")
+// получают битовую карту документов (kTermDense) - фильтр для И; с
+// drop_positions их позиции не хранятся, и фразы с ними держатся на биграммах.
+struct TierOptions {
+    double dense_df = 0.0;   // 0 - без плотного яруса
+    bool drop_positions = false;
+};
 
-    for (const auto& doc : direct_index) {
-        uint64_t title_size = doc.title.size();
-        out.write(reinterpret_cast<const char*>(&title_size), sizeof(title_size));
-        out.write(doc.title.c_str(), title_size);
-        uint64_t url_size = doc.url.size();
-        out.write(reinterpret_cast<const char*>(&url_size), sizeof(url_size));
-        out.write(doc.url.c_str(), url_size);
+struct TierStats {
+    uint64_t dense_terms = 0;
+    uint64_t bitmap_bytes = 0;
+    uint64_t dropped_positions = 0;
+    uint64_t codec_terms[kNumCodecs] = {};
+    uint64_t bloom_bytes = 0;
+};
+
+// Наибольший вклад BM25 одного постинга во всем индексе - шаг квантования
+// индекса вкладов (impact_index.h) без запаса на недостижимые значения.
+static float max_bm25_contribution(const IndexBuilder& b) {
+    uint64_t total_len = 0;
+    for (uint32_t len : b.doc_len) total_len += len;
+    const uint32_t num_docs = (uint32_t)b.doc_len.size();
+    const double avgdl = num_docs ? (double)total_len / num_docs : 0.0;
+    float best = 0.0f;
+    for (const auto& tp : b.postings) {
+        const float idf = bm25_idf(num_docs, (uint32_t)tp.docs.size());
+        for (size_t i = 0; i < tp.docs.size(); i++) {
+            const float norm = bm25_norm(b.doc_len[tp.docs[i]], avgdl, kBm25K1, kBm25B);
+            best = std::max(best, idf * bm25_tf(tp.tfs[i], norm, kBm25K1));
+        }
     }
-    out.close();
+    return best;
 }
 
-void write_inverted_index(const std::vector<InvertedIndex>& inverted_index, const std::string& filename) {
+bool write_inverted_index(IndexBuilder& b, const std::vector<uint32_t>& order, const std::string& filename, uint64_t& postings_bytes,
+                          const TierOptions& tiers = TierOptions(), TierStats* tier_stats = nullptr,
+                          ImpactIndexWriter* impacts = nullptr) {
     std::ofstream out(filename, std::ios::binary);
     if (!out) {
         std::cerr << "Ошибка при открытии файла для записи обратного индекса!" << std::endl;
-        return;
+        return false;
     }
 
-    for (const auto& term : inverted_index) {
-        uint64_t term_size = term.term.size();
-        out.write(reinterpret_cast<const char*>(&term_size), sizeof(term_size));
-        out.write(term.term.c_str(), term_size);
+    IndexHeader h{};
+    std::memcpy(h.magic, kIndexMagic, sizeof(kIndexMagic));
+    h.version = kIndexVersion;
+    h.num_docs = (uint32_t)b.doc_len.size();
+    h.num_terms = (uint32_t)order.size();
+    h.total_postings = b.total_postings;
+    for (uint32_t len : b.doc_len) h.total_doc_len += len;
+    h.bm25_k1 = kBm25K1;
+    h.bm25_b = kBm25B;
+    h.flags = kIndexHasPositions;
+    uint32_t impact_levels = 0;
+    if (b.impact_bits) {
+        impact_levels = (1u << b.impact_bits) - 1;
+        const float best = max_bm25_contribution(b);
+        h.flags |= kIndexHasImpacts;
+        h.impact_bits = b.impact_bits;
+        h.impact_scale = best > 0.0f ? best / impact_levels : 1.0f;
+    }
+    if (b.static_rank.size() == b.doc_len.size() && !b.static_rank.empty()) h.flags |= kIndexHasStaticRank;
+    if (b.bloom_bits > 0.0) h.flags |= kIndexHasBloom;
+    out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+
+    h.doclen_offset = sizeof(h);
+    out.write(reinterpret_cast<const char*>(b.doc_len.data()), b.doc_len.size() * sizeof(uint32_t));
+    if (h.flags & kIndexHasStaticRank) {
+        out.write(reinterpret_cast<const char*>(b.static_rank.data()), b.static_rank.size() * sizeof(float));
+    }
 
-        uint64_t doc_count = term.doc_ids.size();
-        out.write(reinterpret_cast<const char*>(&doc_count), sizeof(doc_count));
-        for (const auto& doc_id : term.doc_ids) {
-            uint64_t doc_id_size = doc_id.size();
-            out.write(reinterpret_cast<const char*>(&doc_id_size), sizeof(doc_id_size));
-            out.write(doc_id.c_str(), doc_id_size);
+    const double avgdl = h.num_docs ? (double)h.total_doc_len / h.num_docs : 0.0;
+    std::vector<float> norm(h.num_docs);
+    for (uint32_t d = 0; d < h.num_docs; d++) norm[d] = bm25_norm(b.doc_len[d], avgdl, kBm25K1, kBm25B);
+
+    h.postings_offset = (uint64_t)out.tellp();
+    std::vector<TermInfo> infos(order.size());
+    std::string buf;
+    uint64_t offset = 0;
+    const std::vector<uint32_t> no_positions;
+    std::vector<float> scores;
+    std::vector<uint32_t> quantized;
+    const uint64_t dense_min_df = tiers.dense_df > 0.0 ? (uint64_t)std::ceil(tiers.dense_df * h.num_docs) : UINT64_MAX;
+    for (uint32_t id = 0; id < order.size(); id++) {
+        TermPostings& tp = b.postings[order[id]];
+        sort_postings(tp);
+
+        TermInfo& ti = infos[id];
+        const bool dense = tp.docs.size() >= std::max<uint64_t>(dense_min_df, 1);
+        const bool drop = dense && tiers.drop_positions;
+        const float idf = bm25_idf(h.num_docs, (uint32_t)tp.docs.size());
+        scores.resize(tp.docs.size());
+        quantized.resize(impact_levels ? tp.docs.size() : 0);
+        for (size_t i = 0; i < tp.docs.size(); i++) {
+            scores[i] = idf * bm25_tf(tp.tfs[i], norm[tp.docs[i]], kBm25K1);
+            if (impact_levels) {
+                quantized[i] = quantize_score(scores[i], h.impact_scale, impact_levels);
+                ti.max_score = std::max(ti.max_score, quantized[i] * h.impact_scale);
+            } else {
+                ti.max_score = std::max(ti.max_score, scores[i]);
+            }
+        }
+        const PostingCodec codec = b.codec >= 0 ? (PostingCodec)b.codec : choose_codec(tp.docs, h.num_docs, b.codec_lambda);
+        ti.flags |= (uint8_t)(codec << kTermCodecShift);
+        if (tier_stats) tier_stats->codec_terms[codec]++;
+        buf.clear();
+        encode_postings(tp.docs, tp.tfs, drop ? no_positions : tp.positions, buf, quantized, b.impact_bits / 8, codec);
+        if (dense) {
+            const size_t at = buf.size();
+            buf.resize(at + ((size_t)h.num_docs + 7) / 8, '\0');
+            for (uint32_t d : tp.docs) buf[at + (d >> 3)] |= (char)(1u << (d & 7));
+            ti.flags |= kTermDense;
+            if (tier_stats) {
+                tier_stats->dense_terms++;
+                tier_stats->bitmap_bytes += buf.size() - at;
+            }
+        }
+        if (drop) {
+            ti.flags |= kTermNoPositions;
+            if (tier_stats) tier_stats->dropped_positions += tp.positions.size();
         }
+        out.write(buf.data(), buf.size());
+
+        ti.df = (uint32_t)tp.docs.size();
+        ti.offset = offset;
+        ti.bytes = (uint32_t)buf.size();
+        if (impacts) impacts->add_term(tp.docs, scores);
+        offset += buf.size();
+
+        tp = TermPostings();
     }
-    out.close();
+    h.postings_bytes = offset;
+
+    h.dict_offset = (uint64_t)out.tellp();
+    for (uint32_t id = 0; id < order.size(); id++) {
+        const std::string& term = b.terms[order[id]];
+        const uint16_t len = (uint16_t)std::min<size_t>(term.size(), UINT16_MAX);
+        const TermInfo& ti = infos[id];
+        out.write(reinterpret_cast<const char*>(&len), sizeof(len));
+        out.write(term.data(), len);
+        out.write(reinterpret_cast<const char*>(&ti.df), sizeof(ti.df));
+        out.write(reinterpret_cast<const char*>(&ti.offset), sizeof(ti.offset));
+        out.write(reinterpret_cast<const char*>(&ti.bytes), sizeof(ti.bytes));
+        out.write(reinterpret_cast<const char*>(&ti.max_score), sizeof(ti.max_score));
+        out.write(reinterpret_cast<const char*>(&ti.flags), sizeof(ti.flags));
+    }
+    h.dict_bytes = (uint64_t)out.tellp() - h.dict_offset;
+
+    if (h.flags & kIndexHasBloom) {
+        std::vector<uint64_t> hashes(order.size());
+        for (uint32_t id = 0; id < order.size(); id++) hashes[id] = hash_token(b.terms[order[id]]);
+        BloomFilter bloom;
+        bloom.build(hashes, b.bloom_bits);
+        bloom.write(out);
+        if (tier_stats) tier_stats->bloom_bytes = bloom.bytes();
+    }
+
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    postings_bytes = h.postings_bytes;
+    return (bool)out;
 }
 
-void parse_tokens(const std::string& text, std::vector<std::string>& tokens) {
-    std::string token;
-    for (char ch : text) {
-        if (std::isalnum(ch)) {
-            token.push_back(ch);
-        } else {
-            if (!token.empty()) {
-                tokens.push_back(to_lower(token));
-                token.clear();
-            }
-        }
+bool write_forward_index(IndexBuilder& b, const std::vector<uint32_t>& order, const std::string& filename, uint64_t& bytes) {
+    std::ofstream out(filename, std::ios::binary);
+    if (!out) {
+        std::cerr << "Ошибка при открытии файла для записи прямого индекса векторов!" << std::endl;
+        return false;
     }
-    if (!token.empty()) {
-        tokens.push_back(to_lower(token));
+
+    std::vector<uint32_t> remap(order.size());
+    for (uint32_t id = 0; id < order.size(); id++) remap[order[id]] = id;
+
+    const uint32_t num_docs = (uint32_t)b.forward.size();
+    std::vector<uint64_t> offsets;
+    offsets.reserve(num_docs + 1);
+    std::string data;
+    for (auto& vec : b.forward) {
+        offsets.push_back(data.size());
+        for (auto& entry : vec) entry.first = remap[entry.first];
+        std::sort(vec.begin(), vec.end());
+        encode_forward(vec, data);
+        std::vector<std::pair<uint32_t, uint32_t>>().swap(vec);
     }
+    offsets.push_back(data.size());
+
+    out.write(kForwardMagic, sizeof(kForwardMagic));
+    out.write(reinterpret_cast<const char*>(&num_docs), sizeof(num_docs));
+    out.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+    out.write(data.data(), data.size());
+    bytes = (uint64_t)out.tellp();
+    return (bool)out;
 }
 
-void log_statistics(double total_time, uint64_t total_tokens, uint64_t total_docs, uint64_t total_terms, double avg_term_length) {
+void log_statistics(double total_time, uint64_t total_tokens, uint64_t total_docs, uint64_t total_terms, uint64_t total_bytes, double avg_term_length) {
+    const double tokens_per_sec = total_time > 0.0 ? total_tokens / total_time : 0.0;
+    const double tokens_per_doc = total_docs ? (double)total_tokens / (double)total_docs : 0.0;
+    const double text_kb = total_bytes / 1024.0;
+    const double tokens_per_kb = text_kb > 0.0 ? total_tokens / text_kb : 0.0;
+
     std::ofstream log_file("/app/logs/indexing_log.txt", std::ios::app);
     if (!log_file.is_open()) {
         std::cerr << "Ошибка при открытии файла для логирования!" << std::endl;
@@ -96,9 +425,9 @@ void log_statistics(double total_time, uint64_t total_tokens, uint64_t total_doc
     log_file << "Общее количество токенов: " << total_tokens << std::endl;
     log_file << "Количество термов (уникальных токенов): " << total_terms << std::endl;
     log_file << "Средняя длина терма: " << avg_term_length << std::endl;
-    log_file << "Скорость индексации: " << total_tokens / total_time << " токенов в секунду" << std::endl;
-    log_file << "Скорость индексации на один документ: " << total_tokens / total_docs << " токенов на документ" << std::endl;
-    log_file << "Скорость индексации на килобайт текста: " << (total_tokens * 1.0) / (total_terms / 1024) << " токенов на килобайт текста" << std::endl;
+    log_file << "Скорость индексации: " << tokens_per_sec << " токенов в секунду" << std::endl;
+    log_file << "Скорость индексации на один документ: " << tokens_per_doc << " токенов на документ" << std::endl;
+    log_file << "Скорость индексации на килобайт текста: " << tokens_per_kb << " токенов на килобайт текста" << std::endl;
     log_file << std::endl;
     log_file.close();
 
@@ -110,88 +439,576 @@ void log_statistics(double total_time, uint64_t total_tokens, uint64_t total_doc
     std::cout << "Средняя длина терма: " << avg_term_length << std::endl;
 }
 
-int main() {
+struct DedupOptions {
+    bool enabled = false;
+    std::string minhash_path = "data/tokens/minhash.bin";
+    std::string report_path = "data/duplicates.tsv";
+    uint32_t bands = 16;
+    double threshold = 0.8;
+};
+
+// Ищет почти-дубликаты по MinHash-сигнатурам токенизатора и пишет кластеры
+// в report_path (representative \t member \t similarity). Возвращает doc_id
+// членов кластеров, которые не надо индексировать (если включен режим --dedup).
+std::unordered_set<std::string> detect_near_duplicates(const DedupOptions& opt, metrics::Registry& reg) {
+    std::unordered_set<std::string> skip;
+
+    metrics::Timer lsh_timer;
+    std::vector<MinHashSignature> sigs;
+    if (!load_minhash(opt.minhash_path, sigs)) {
+        std::cerr << "MinHash-сигнатуры не найдены (" << opt.minhash_path << "), поиск почти-дубликатов пропущен" << std::endl;
+        return skip;
+    }
+
+    const std::vector<DuplicateCluster> clusters = find_near_duplicates(sigs, opt.bands, opt.threshold);
+
+    std::ofstream report(opt.report_path, std::ios::binary);
+    uint64_t members = 0;
+    for (const auto& c : clusters) {
+        for (size_t i = 0; i < c.members.size(); i++) {
+            report << sigs[c.representative].doc_id << "\t" << sigs[c.members[i]].doc_id << "\t" << c.similarity[i] << "\n";
+            if (opt.enabled) skip.insert(sigs[c.members[i]].doc_id);
+        }
+        members += c.members.size();
+    }
+
+    reg.counter("near_dup_clusters_total", "Найдено кластеров почти-дубликатов").inc(clusters.size());
+    reg.counter("near_dup_members_total", "Документов-дубликатов (без представителей)").inc(members);
+    reg.gauge("lsh_seconds", "Время поиска почти-дубликатов, с").set(lsh_timer.seconds());
+
+    std::cout << "Кластеров почти-дубликатов: " << clusters.size() << ", дубликатов: " << members
+              << " (порог " << opt.threshold << ", полос " << opt.bands << ")" << std::endl;
+    std::cout << "Кластеры сохранены в: " << opt.report_path << std::endl;
+    return skip;
+}
+
+int main(int argc, char** argv) {
+    // Корпус (JSONL из export_corpus.py или дамп mongodump *.bson) дает заголовки и ссылки,
+    // словопозиции строятся по потоку токенов после стеммера (TSV, бинарный или "-").
+    std::string corpus_path = "data/corpus.jsonl";
+    std::string tokens_path = fs::exists("data/tokens/tokens_stem.tsv") ? "data/tokens/tokens_stem.tsv" : "data/tokens/tokens.tsv";
+    std::string numbers_path = "data/tokens/numbers.tsv";
+    std::string out_dir = "data";
+    std::string synonyms_path = fs::exists("synonyms.txt") ? "synonyms.txt" : "";
+    size_t biwords = 1000;
+    TierOptions tiers;
+    tiers.dense_df = 0.5;
+    DedupOptions dedup;
+    StaticRankOptions rank_opt;
+    bool impacts = false;
+    bool sort_inversion = false;
+    uint32_t impact_bits = 0;
+    int codec = -1;
+    double codec_lambda = IndexBuilder().codec_lambda;
+    double mphf_gamma = 2.0;   // 0 - без хеш-функции термов
+    double bloom_bits = IndexBuilder().bloom_bits;
+    for (int i = 1; i < argc; i++) {
+        const std::string a = argv[i];
+        if (a == "--dedup") dedup.enabled = true;
+        else if (a == "--minhash" && i + 1 < argc) dedup.minhash_path = argv[++i];
+        else if (a == "--lsh-bands" && i + 1 < argc) dedup.bands = (uint32_t)std::stoul(argv[++i]);
+        else if (a == "--lsh-threshold" && i + 1 < argc) dedup.threshold = std::stod(argv[++i]);
+        else if (a == "--tokens" && i + 1 < argc) tokens_path = argv[++i];
+        else if (a == "--numbers" && i + 1 < argc) numbers_path = argv[++i];
+        else if (a == "--out" && i + 1 < argc) out_dir = argv[++i];
+        else if (a == "--synonyms" && i + 1 < argc) synonyms_path = argv[++i];
+        else if (a == "--biwords" && i + 1 < argc) biwords = std::stoul(argv[++i]);
+        else if (a == "--dense-df" && i + 1 < argc) tiers.dense_df = std::stod(argv[++i]);
+        else if (a == "--drop-dense-positions") tiers.drop_positions = true;
+        else if (a == "--no-static-rank") rank_opt.enabled = false;
+        else if (a == "--impacts") impacts = true;
+        else if (a == "--sort-inversion") sort_inversion = true;
+        else if (a == "--mphf-gamma" && i + 1 < argc) mphf_gamma = std::stod(argv[++i]);
+        else if (a == "--bloom-bits" && i + 1 < argc) bloom_bits = std::stod(argv[++i]);
+        else if (a == "--codec-lambda" && i + 1 < argc) codec_lambda = std::stod(argv[++i]);
+        else if (a == "--codec" && i + 1 < argc) {
+            // auto или имя кодека для всех списков
+            const std::string v = argv[++i];
+            codec = -1;
+            for (uint32_t c = 0; c < kNumCodecs; c++) {
+                if (v == codec_name((PostingCodec)c)) codec = (int)c;
+            }
+            if (codec < 0 && v != "auto") {
+                std::cerr << "Неизвестный кодек списков: " << v << " (auto, vbyte, ef, raw, packed, bitmap)" << std::endl;
+                return 1;
+            }
+        }
+        else if (a == "--quantize-impacts" && i + 1 < argc) impact_bits = (uint32_t)std::stoul(argv[++i]);
+        else if (a == "--rank-weights" && i + 1 < argc) {
+            // длина,ссылки,источник
+            char sep1 = 0, sep2 = 0;
+            std::istringstream ss(argv[++i]);
+            ss >> rank_opt.length_weight >> sep1 >> rank_opt.links_weight >> sep2 >> rank_opt.source_weight;
+        } else if (a == "--source-prior" && i + 1 < argc) {
+            const std::string v = argv[++i];
+            const size_t eq = v.find('=');
+            if (eq != std::string::npos) rank_opt.source_prior[v.substr(0, eq)] = std::stof(v.substr(eq + 1));
+        }
+        else corpus_path = a;
+    }
+    if (impact_bits != 0 && impact_bits != 8 && impact_bits != 16) {
+        std::cerr << "Вклады квантуются в 8 или 16 бит" << std::endl;
+        return 1;
+    }
+    if (dedup.bands == 0 || kMinHashSize % dedup.bands != 0) {
+        std::cerr << "Число полос LSH должно делить " << kMinHashSize << std::endl;
+        return 1;
+    }
+
     std::cout << "Начинаем индексацию..." << std::endl;
 
     auto start_time = std::chrono::high_resolution_clock::now();
 
-    std::ifstream corpus_file("data/corpus.jsonl");
-    if (!corpus_file) {
-        std::cerr << "Не удалось открыть файл corpus.jsonl!" << std::endl;
+    const bool bson_input = is_bson_path(corpus_path);
+    BsonDumpReader bson;
+    std::ifstream corpus_file;
+    const bool opened = bson_input ? bson.open(corpus_path) : (corpus_file.open(corpus_path), (bool)corpus_file);
+    if (!opened) {
+        std::cerr << "Не удалось открыть файл " << corpus_path << "!" << std::endl;
+        return 1;
+    }
+
+    TokenReader tokens;
+    if (!tokens.open(tokens_path)) {
+        std::cerr << "Не удалось открыть файл токенов " << tokens_path << "!" << std::endl;
         return 1;
     }
 
     std::cout << "Файл с корпусом загружен." << std::endl;
 
     std::vector<DirectIndex> direct_index;
-    std::vector<InvertedIndex> inverted_index;
+    std::unordered_map<std::string, uint32_t> doc_ord;
+    // Для статического ранга: число слов и ключи исходящих ссылок документа.
+    std::vector<uint32_t> doc_words;
+    std::vector<std::vector<uint64_t>> doc_links;
+    std::vector<uint64_t> links;
 
     std::string line;
     uint64_t total_tokens = 0;
     uint64_t total_docs = 0;
     uint64_t total_terms = 0;
+    uint64_t total_bytes = 0;
+
+    metrics::Registry reg("indexer");
+    auto& m_parse_errors = reg.counter("json_parse_errors_total", "Строк корпуса, которые не удалось разобрать");
+    auto& m_duplicates = reg.counter("duplicate_docs_total", "Документов с повторным doc_id");
+    auto& m_unknown = reg.counter("unknown_token_docs_total", "Документов в потоке токенов, которых нет в корпусе");
+    auto& m_doc_us = reg.histogram("doc_index_us", "Время индексации одного документа, мкс");
+
+    const std::unordered_set<std::string> dedup_skip = detect_near_duplicates(dedup, reg);
+    uint64_t dedup_docs = 0;
+    uint64_t dedup_postings = 0;
+
+    // Проход по корпусу: внутренние номера документов и прямой индекс.
+    auto add_doc_meta = [&](const std::string& doc_id, const std::string& title, const std::string& url,
+                            const std::string& source, std::string_view clean_text) {
+        total_bytes += clean_text.size();
+
+        // Член кластера почти-дубликатов: в индекс идет только представитель.
+        if (dedup_skip.count(doc_id)) {
+            dedup_docs++;
+            return;
+        }
 
-    std::set<std::string> doc_ids_set;
+        // Повторный doc_id не индексируется: поток токенов ключуется по doc_id,
+        // и токены двух документов с одним id не различить.
+        if (doc_ord.count(doc_id)) {
+            std::cerr << "Найден дубликат документа с ID: " << doc_id << ", документ пропущен" << std::endl;
+            m_duplicates.inc();
+            return;
+        }
 
-    while (std::getline(corpus_file, line)) {
-        std::istringstream line_stream(line);
-        Json::Reader reader;
-        Json::Value doc_data;
+        doc_ord.emplace(doc_id, (uint32_t)direct_index.size());
+        direct_index.push_back({doc_id, title, url, source});
+        if (rank_opt.enabled) {
+            doc_words.push_back((uint32_t)std::count(clean_text.begin(), clean_text.end(), ' ') + 1);
+            std::sort(links.begin(), links.end());
+            links.erase(std::unique(links.begin(), links.end()), links.end());
+            doc_links.push_back(links);
+        }
+    };
+
+    if (bson_input) {
+        BsonCorpusDoc doc;
+        while (bson.next(doc)) {
+            links.clear();
+            if (rank_opt.enabled) extract_links(doc.raw_html, doc.normalized_url, links);
+            add_doc_meta(std::string(doc.doc_id()), std::string(doc.title), std::string(doc.normalized_url),
+                         std::string(doc.source_name), doc.clean_text);
+        }
+        if (bson.corrupted()) {
+            std::cerr << "Дамп поврежден после " << bson.bytes_read() << " байт, остаток пропущен" << std::endl;
+        }
+    } else {
+        while (std::getline(corpus_file, line)) {
+            Json::Reader reader;
+            Json::Value doc_data;
+
+            if (!reader.parse(line, doc_data)) {
+                std::cerr << "Ошибка при парсинге строки JSON!" << std::endl;
+                m_parse_errors.inc();
+                continue;
+            }
 
-        if (!reader.parse(line, doc_data)) {
-            std::cerr << "Ошибка при парсинге строки JSON!" << std::endl;
-            continue;
+            links.clear();
+            for (const auto& l : doc_data["links"]) {
+                if (l.isString()) links.push_back(link_key(strip_url_tail(l.asString())));
+            }
+            add_doc_meta(doc_data["doc_id"].asString(), doc_data["title"].asString(), doc_data["normalized_url"].asString(),
+                         doc_data["source_name"].asString(), doc_data["clean_text"].asString());
         }
+    }
+    corpus_file.close();
 
-        std::string doc_id = doc_data["doc_id"].asString();
-        std::string title = doc_data["title"].asString();
-        std::string url = doc_data["normalized_url"].asString();
-        std::string clean_text = doc_data["clean_text"].asString();
+    // Документы перенумеровываются по убыванию статического ранга; дальше
+    // все индексы строятся уже в этой нумерации.
+    std::vector<float> static_rank;
+    uint64_t corpus_links = 0;
+    if (rank_opt.enabled && !direct_index.empty()) {
+        std::unordered_map<uint64_t, uint32_t> url_ord;
+        for (uint32_t d = 0; d < direct_index.size(); d++) url_ord.emplace(link_key(direct_index[d].url), d);
+        std::vector<uint32_t> inlinks(direct_index.size(), 0);
+        std::vector<std::string> sources(direct_index.size());
+        for (uint32_t d = 0; d < direct_index.size(); d++) {
+            sources[d] = direct_index[d].source;
+            for (uint64_t key : doc_links[d]) {
+                auto it = url_ord.find(key);
+                if (it == url_ord.end() || it->second == d) continue;
+                inlinks[it->second]++;
+                corpus_links++;
+            }
+        }
+        std::vector<std::vector<uint64_t>>().swap(doc_links);
+        const std::vector<float> rank = compute_static_rank(rank_opt, doc_words, sources, inlinks);
+
+        std::vector<uint32_t> perm(direct_index.size());
+        for (uint32_t d = 0; d < perm.size(); d++) perm[d] = d;
+        std::stable_sort(perm.begin(), perm.end(), [&](uint32_t a, uint32_t b) { return rank[a] > rank[b]; });
+        std::vector<DirectIndex> ranked(direct_index.size());
+        static_rank.resize(direct_index.size());
+        for (uint32_t d = 0; d < perm.size(); d++) {
+            ranked[d] = std::move(direct_index[perm[d]]);
+            static_rank[d] = rank[perm[d]];
+            doc_ord[ranked[d].doc_id] = d;
+        }
+        direct_index = std::move(ranked);
+        std::cout << "Статический ранг: ссылок внутри корпуса " << corpus_links << ", ранг от " << static_rank.back()
+                  << " до " << static_rank.front() << std::endl;
+    }
 
-        if (doc_ids_set.find(doc_id) != doc_ids_set.end()) {
-            std::cerr << "Найден дубликат документа с ID: " << doc_id << std::endl;
-        } else {
-            doc_ids_set.insert(doc_id);
+    // Проход по токенам: токены одного документа идут подряд.
+    IndexBuilder builder;
+    builder.doc_len.assign(direct_index.size(), 0);
+    builder.static_rank = static_rank;
+    builder.impact_bits = impact_bits;
+    builder.codec = codec;
+    builder.codec_lambda = codec_lambda;
+    builder.bloom_bits = bloom_bits;
+    builder.forward.resize(direct_index.size());
+    std::vector<bool> done(direct_index.size(), false);
+
+    std::string cur_doc;
+    int64_t cur_ord = -1;
+    bool cur_dedup = false;
+    bool have_doc = false;
+    std::vector<std::pair<uint32_t, uint32_t>> seq;
+    uint32_t doc_positions = 0;
+    uint32_t last_pos = 0;
+    uint32_t last_word = 0;
+    std::unordered_set<std::string> dedup_terms;
+    // Кандидаты в биграммы: первый терм каждой позиции (само слово, а не
+    // части составного слова или терм словосочетания) и терм предыдущей.
+    FrequentPairs pair_counter(std::max<size_t>(4 * biwords, 1024));
+    metrics::Timer doc_timer;
+
+    auto flush_doc = [&]() {
+        if (cur_ord >= 0) {
+            total_tokens += doc_positions;
+            builder.add_doc((uint32_t)cur_ord, seq, doc_positions);
+            done[cur_ord] = true;
+            total_docs++;
+            m_doc_us.record(doc_timer.us());
+        } else if (cur_dedup) {
+            dedup_postings += dedup_terms.size();
+        }
+        seq.clear();
+        doc_positions = 0;
+        dedup_terms.clear();
+    };
+
+    builder.sort_inversion = sort_inversion;
+    metrics::Timer invert_timer;
+    TokenRecord rec;
+    while (tokens.next(rec)) {
+        if (!have_doc || rec.doc_id != cur_doc) {
+            flush_doc();
+            have_doc = true;
+            cur_doc.assign(rec.doc_id.data(), rec.doc_id.size());
+            doc_timer.reset();
+            auto it = doc_ord.find(cur_doc);
+            cur_ord = (it != doc_ord.end() && !done[it->second]) ? (int64_t)it->second : -1;
+            cur_dedup = dedup_skip.count(cur_doc) > 0;
+            if (it == doc_ord.end() && !cur_dedup) m_unknown.inc();
         }
+        if (cur_ord >= 0) {
+            const uint32_t term = builder.term_id(rec.token);
+            if (seq.empty() || rec.pos != last_pos) {
+                if (biwords && !seq.empty() && rec.pos == last_pos + 1) pair_counter.add(last_word, term);
+                last_word = term;
+                doc_positions++;
+            }
+            last_pos = rec.pos;
+            seq.emplace_back(term, rec.pos);
+        } else if (cur_dedup) {
+            dedup_terms.emplace(rec.token);
+        }
+    }
+    flush_doc();
+    if (sort_inversion) {
+        metrics::Timer sort_timer;
+        RadixSortStats sort_stats;
+        const unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+        const size_t pairs = builder.run_keys.size();
+        builder.invert_runs(threads, &sort_stats);
+        reg.gauge("invert_sort_seconds", "Время сортировки пар (терм, документ) и сборки списков, с").set(sort_timer.seconds());
+        std::cout << "Инвертирование сортировкой: " << pairs << " пар, проходов " << sort_stats.passes << ", "
+                  << sort_timer.seconds() << " с (" << threads << " потоков)" << std::endl;
+    }
+    reg.gauge("invert_seconds", "Время прохода по токенам с инвертированием, с").set(invert_timer.seconds());
+    reg.gauge("invert_peak_rss_bytes", "Пиковая резидентная память после инвертирования, байт").set((double)peak_rss_bytes());
+    if (tokens.corrupted()) {
+        std::cerr << "Поток токенов оборван, индекс построен по прочитанной части" << std::endl;
+    }
 
-        direct_index.push_back({doc_id, title, url});
+    total_docs = direct_index.size();
+    total_terms = builder.terms.size();
 
-        std::vector<std::string> tokens;
-        parse_tokens(clean_text, tokens);
-        total_tokens += tokens.size();
+    std::cout << "Индексация завершена. Запись в файлы..." << std::endl;
 
-        for (const auto& token : tokens) {
-            bool found = false;
-            for (auto& inverted_entry : inverted_index) {
-                if (inverted_entry.term == token) {
-                    inverted_entry.doc_ids.push_back(doc_id);
-                    found = true;
-                    break;
-                }
-            }
-            if (!found) {
-                inverted_index.push_back({token, {doc_id}});
-                total_terms++;
+    fs::create_directories(out_dir);
+    const std::vector<uint32_t> order = sorted_term_order(builder.terms);
+    const uint64_t total_postings = builder.total_postings;
+    uint64_t postings_bytes = 0;
+    uint64_t forward_bytes = 0;
+    write_direct_index(direct_index, out_dir + "/direct_index.bin");
+
+    // Отдельный индекс по заголовкам - признак для переранжирования.
+    IndexBuilder title_builder;
+    title_builder.codec = codec;
+    title_builder.codec_lambda = codec_lambda;
+    title_builder.bloom_bits = bloom_bits;
+    title_builder.doc_len.assign(direct_index.size(), 0);
+    title_builder.forward.resize(direct_index.size());
+    for (uint32_t d = 0; d < direct_index.size(); d++) {
+        const std::vector<std::string> words = normalize_query_text(direct_index[d].title);
+        seq.clear();
+        for (uint32_t i = 0; i < words.size(); i++) seq.emplace_back(title_builder.term_id(words[i]), i);
+        title_builder.add_doc(d, seq, (uint32_t)words.size());
+    }
+    uint64_t title_bytes = 0;
+    if (!write_inverted_index(title_builder, sorted_term_order(title_builder.terms), out_dir + "/title_index.bin", title_bytes)) {
+        return 1;
+    }
+
+    // Числовой индекс строится, только если токенизатор выписал числа.
+    TokenReader numbers;
+    uint64_t numeric_pairs = 0;
+    if (numbers.open(numbers_path)) {
+        std::vector<std::pair<uint64_t, uint32_t>> pairs;
+        TokenRecord num;
+        while (numbers.next(num)) {
+            auto it = doc_ord.find(std::string(num.doc_id));
+            if (it == doc_ord.end()) continue;
+            uint64_t v = 0;
+            bool ok = !num.token.empty() && num.token.size() <= 18;
+            for (char c : num.token) {
+                if (c < '0' || c > '9') { ok = false; break; }
+                v = v * 10 + (uint64_t)(c - '0');
             }
+            if (ok) pairs.emplace_back(v, it->second);
         }
+        if (!write_numeric_index(pairs, out_dir + "/numeric_index.bin")) {
+            std::cerr << "Ошибка при записи числового индекса!" << std::endl;
+            return 1;
+        }
+        numeric_pairs = pairs.size();
+        std::cout << "Числовой индекс: " << numeric_pairs << " пар (число, документ)" << std::endl;
+    }
 
-        total_docs++;
+    // Второе пространство ключей: латинские термы по ключу транслитерации,
+    // id - номер терма в отсортированном словаре.
+    std::vector<std::pair<std::string, uint32_t>> translit;
+    for (uint32_t id = 0; id < order.size(); id++) {
+        const std::string& term = builder.terms[order[id]];
+        std::wstring key;
+        try {
+            key = translit_key(utf8_to_wstring(term));
+        } catch (...) {
+            continue;
+        }
+        if (!key.empty()) translit.emplace_back(wstring_to_utf8(key), id);
+    }
+    if (!write_translit_index(translit, out_dir + "/translit_index.bin")) {
+        std::cerr << "Ошибка при записи индекса транслитерации!" << std::endl;
+        return 1;
+    }
+    std::cout << "Латинских термов с ключом транслитерации: " << translit.size() << std::endl;
+
+    // Словарь синонимов компилируется в таблицу id отсортированного словаря.
+    SynonymTable synonyms;
+    size_t synonym_groups = 0;
+    const std::string synonyms_out = out_dir + "/synonyms.bin";
+    if (!synonyms_path.empty()) {
+        std::vector<uint32_t> sorted_id(order.size());
+        for (uint32_t id = 0; id < order.size(); id++) sorted_id[order[id]] = id;
+        auto lookup = [&](const std::string& term) -> int64_t {
+            auto it = builder.term_ids.find(term);
+            return it == builder.term_ids.end() ? -1 : (int64_t)sorted_id[it->second];
+        };
+        if (!compile_synonyms(synonyms_path, lookup, synonyms, &synonym_groups)) {
+            std::cerr << "Не удалось открыть файл синонимов " << synonyms_path << "!" << std::endl;
+            return 1;
+        }
+        if (!write_synonyms(synonyms, synonyms_out)) {
+            std::cerr << "Ошибка при записи таблицы синонимов!" << std::endl;
+            return 1;
+        }
+        std::cout << "Синонимы: " << synonym_groups << " групп, " << synonyms.size() << " термов-ключей" << std::endl;
+    } else {
+        fs::remove(synonyms_out);
     }
-    corpus_file.close();
 
-    std::cout << "Индексация завершена. Запись в файлы..." << std::endl;
+    // Индекс биграмм; без него (--biwords 0) фразы проверяются по позициям.
+    IndexBuilder biword_builder;
+    biword_builder.codec = codec;
+    biword_builder.codec_lambda = codec_lambda;
+    biword_builder.bloom_bits = bloom_bits;
+    uint64_t biword_bytes = 0;
+    const std::string biword_path = out_dir + "/biword_index.bin";
+    if (biwords > 0) {
+        metrics::Timer biword_timer;
+        build_biwords(builder, pair_counter.top(biwords), biword_builder);
+        if (!write_inverted_index(biword_builder, sorted_term_order(biword_builder.terms), biword_path, biword_bytes)) {
+            return 1;
+        }
+        reg.gauge("biword_seconds", "Время построения индекса биграмм, с").set(biword_timer.seconds());
+        std::cout << "Индекс биграмм: " << biword_builder.terms.size() << " пар, " << biword_builder.total_postings
+                  << " постингов, " << biword_bytes << " байт (пар в потоке: " << pair_counter.total() << ")" << std::endl;
+    } else {
+        fs::remove(biword_path);
+    }
+
+    // Списки по убыванию вклада для вычисления "по оценкам" (impact_index.h).
+    ImpactIndexWriter impact_writer;
+    const std::string impact_path = out_dir + "/impact_index.bin";
+    if (impacts) {
+        if (!impact_writer.open(impact_path, (uint32_t)builder.doc_len.size(), max_bm25_contribution(builder))) {
+            std::cerr << "Ошибка при открытии файла для записи индекса вкладов!" << std::endl;
+            return 1;
+        }
+    } else {
+        fs::remove(impact_path);
+    }
+
+    TierStats tier_stats;
+    if (!write_inverted_index(builder, order, out_dir + "/inverted_index.bin", postings_bytes, tiers, &tier_stats,
+                              impacts ? &impact_writer : nullptr) ||
+        !write_forward_index(builder, order, out_dir + "/forward_index.bin", forward_bytes)) {
+        return 1;
+    }
+    // Хеш-функция терм -> id для поисковика; строится, пока строки словаря в памяти.
+    MphfBuildStats mphf_stats;
+    const std::string term_hash_path = out_dir + "/term_hash.bin";
+    if (mphf_gamma > 0.0) {
+        metrics::Timer mphf_timer;
+        std::vector<std::string_view> sorted_terms(order.size());
+        for (uint32_t id = 0; id < order.size(); id++) sorted_terms[id] = builder.terms[order[id]];
+        const unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+        if (!write_term_hash(sorted_terms, term_hash_path, std::max(1.0, mphf_gamma), threads, &mphf_stats)) {
+            std::cerr << "Ошибка при записи хеш-функции термов!" << std::endl;
+            return 1;
+        }
+        reg.gauge("mphf_seconds", "Время построения хеш-функции термов, с").set(mphf_timer.seconds());
+        std::cout << "Хеш-функция термов: " << mphf_stats.levels << " уровней, запасных ключей " << mphf_stats.fallback
+                  << ", " << mphf_stats.bytes << " байт (" << threads << " потоков)" << std::endl;
+    } else {
+        fs::remove(term_hash_path);
+    }
 
-    write_direct_index(direct_index, "data/direct_index.bin");
-    write_inverted_index(inverted_index, "data/inverted_index.bin");
+    uint64_t impact_bytes = 0;
+    if (impacts) {
+        if (!impact_writer.finish()) {
+            std::cerr << "Ошибка при записи индекса вкладов!" << std::endl;
+            return 1;
+        }
+        impact_bytes = impact_writer.bytes();
+        std::cout << "Индекс вкладов: " << impact_writer.postings() << " постингов, " << impact_bytes
+                  << " байт, шаг квантования " << impact_writer.scale() << std::endl;
+    }
 
     auto end_time = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double> total_duration = end_time - start_time;
     double total_time = total_duration.count();
 
-    double avg_term_length = total_tokens / static_cast<double>(total_terms);
+    // Средняя длина терма словаря в символах UTF-8.
+    uint64_t term_chars = 0;
+    for (const auto& t : builder.terms) {
+        for (unsigned char c : t) term_chars += (c & 0xC0) != 0x80;
+    }
+    double avg_term_length = total_terms ? term_chars / static_cast<double>(total_terms) : 0.0;
+
+    if (dedup.enabled) {
+        // Байты оцениваются по среднему размеру постинга в обратном и прямом индексе.
+        const double bytes_per_posting = total_postings ? (double)(postings_bytes + forward_bytes) / total_postings : 0.0;
+        const uint64_t dedup_bytes = (uint64_t)(dedup_postings * bytes_per_posting);
+        reg.counter("dedup_skipped_docs_total", "Не проиндексировано документов-дубликатов").inc(dedup_docs);
+        reg.counter("dedup_saved_postings_total", "Сэкономлено постингов").inc(dedup_postings);
+        reg.counter("dedup_saved_bytes_total", "Сэкономлено байт индекса").inc(dedup_bytes);
+        std::cout << "Пропущено дубликатов: " << dedup_docs << ", сэкономлено постингов: " << dedup_postings
+                  << ", байт индекса: " << dedup_bytes << std::endl;
+    }
 
-    log_statistics(total_time, total_tokens, total_docs, total_terms, avg_term_length);
+    log_statistics(total_time, total_tokens, total_docs, total_terms, total_bytes, avg_term_length);
+
+    reg.counter("docs_total", "Проиндексировано документов").inc(total_docs);
+    reg.counter("tokens_total", "Токенов").inc(total_tokens);
+    reg.counter("input_bytes_total", "Байт clean_text на входе").inc(total_bytes);
+    reg.counter("postings_total", "Постингов (документ, терм)").inc(total_postings);
+    reg.gauge("terms", "Число уникальных термов").set((double)total_terms);
+    reg.gauge("numeric_pairs", "Пар (число, документ) в числовом индексе").set((double)numeric_pairs);
+    reg.gauge("postings_bytes", "Размер списков словопозиций, байт").set((double)postings_bytes);
+    reg.gauge("forward_index_bytes", "Размер прямого индекса векторов, байт").set((double)forward_bytes);
+    reg.gauge("biword_terms", "Биграмм в индексе биграмм").set((double)biword_builder.terms.size());
+    reg.gauge("translit_terms", "Латинских термов во втором пространстве ключей").set((double)translit.size());
+    reg.gauge("synonym_keys", "Термов с синонимами в таблице синонимов").set((double)synonyms.size());
+    reg.counter("corpus_links_total", "Ссылок между документами корпуса (статический ранг)").inc(corpus_links);
+    reg.gauge("impact_index_bytes", "Размер индекса вкладов (impact_index.bin), байт").set((double)impact_bytes);
+    reg.gauge("term_hash_bytes", "Размер хеш-функции термов с таблицей слотов, байт").set((double)mphf_stats.bytes);
+    reg.gauge("bloom_bytes", "Размер фильтра Блума по термам основного индекса, байт").set((double)tier_stats.bloom_bytes);
+    reg.gauge("dense_terms", "Термов плотного яруса (с битовой картой)").set((double)tier_stats.dense_terms);
+    reg.gauge("dense_bitmap_bytes", "Размер битовых карт плотного яруса, байт").set((double)tier_stats.bitmap_bytes);
+    reg.counter("dropped_positions_total", "Не сохранено позиций термов плотного яруса").inc(tier_stats.dropped_positions);
+    for (uint32_t c = 0; c < kNumCodecs; c++) {
+        reg.gauge(std::string("codec_terms_") + codec_name((PostingCodec)c), "Термов, списки которых в этом кодеке")
+            .set((double)tier_stats.codec_terms[c]);
+    }
+    reg.gauge("biword_postings_bytes", "Размер списков индекса биграмм, байт").set((double)biword_bytes);
+    reg.gauge("elapsed_seconds", "Общее время индексации, с").set(total_time);
+    reg.gauge("peak_rss_bytes", "Пиковая резидентная память индексатора, байт").set((double)peak_rss_bytes());
+    reg.gauge("tokens_per_second", "Пропускная способность, токенов/с").set(total_time > 0.0 ? total_tokens / total_time : 0.0);
+    if (!metrics::dump_json(reg)) {
+        std::cerr << "Не удалось записать метрики в " << metrics::metrics_dir() << std::endl;
+    }
 
+    std::cout << "Постингов: " << total_postings << ", списки: " << postings_bytes
+              << " байт, прямой индекс: " << forward_bytes << " байт" << std::endl;
+    std::cout << "Кодеки списков:";
+    for (uint32_t c = 0; c < kNumCodecs; c++) std::cout << " " << codec_name((PostingCodec)c) << " " << tier_stats.codec_terms[c];
+    std::cout << std::endl;
+    if (tier_stats.dense_terms) {
+        std::cout << "Плотный ярус: " << tier_stats.dense_terms << " термов, битовые карты " << tier_stats.bitmap_bytes
+                  << " байт, позиций не сохранено: " << tier_stats.dropped_positions << std::endl;
+    }
     std::cout << "Булев индекс успешно создан!" << std::endl;
     return 0;
 }
@@ -0,0 +1,273 @@
+#pragma once
+
+// Общий реестр метрик для всех C++-утилит: счетчики, gauge-значения и
+// гистограммы задержек в HDR-раскладке (логарифмические корзины с линейным
+// делением внутри, относительная погрешность ~1.5%).
+// В конце пакетного прогона реестр сбрасывается в JSON, поисковик
+// дополнительно отдает его в текстовом формате Prometheus.
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+
+namespace metrics {
+
+class Counter {
+public:
+    void inc(uint64_t n = 1) { v_.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t value() const { return v_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> v_{0};
+};
+
+class Gauge {
+public:
+    void set(double v) { v_.store(v, std::memory_order_relaxed); }
+    void add(double d) {
+        double cur = v_.load(std::memory_order_relaxed);
+        while (!v_.compare_exchange_weak(cur, cur + d, std::memory_order_relaxed)) {}
+    }
+    double value() const { return v_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<double> v_{0.0};
+};
+
+// Значения < 128 хранятся точно, для больших сохраняются старшие 7 бит.
+class Histogram {
+public:
+    static constexpr int kSubBits = 7;
+    static constexpr uint64_t kSub = 1ull << kSubBits;
+    static constexpr uint64_t kHalf = kSub / 2;
+    static constexpr size_t kBuckets = kSub + (64 - kSubBits) * kHalf;
+
+    Histogram() : counts_(new std::atomic<uint64_t>[kBuckets]()) {}
+
+    void record(uint64_t v) {
+        counts_[bucket_of(v)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(v, std::memory_order_relaxed);
+        uint64_t m = min_.load(std::memory_order_relaxed);
+        while (v < m && !min_.compare_exchange_weak(m, v, std::memory_order_relaxed)) {}
+        m = max_.load(std::memory_order_relaxed);
+        while (v > m && !max_.compare_exchange_weak(m, v, std::memory_order_relaxed)) {}
+    }
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t sum() const { return sum_.load(std::memory_order_relaxed); }
+    uint64_t min() const { return count() ? min_.load(std::memory_order_relaxed) : 0; }
+    uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+    double mean() const { return count() ? (double)sum() / (double)count() : 0.0; }
+
+    // q в диапазоне [0, 1]; возвращает верхнюю границу корзины, не больше max.
+    uint64_t percentile(double q) const {
+        const uint64_t n = count();
+        if (n == 0) return 0;
+        uint64_t rank = (uint64_t)(q * (double)n + 0.5);
+        if (rank < 1) rank = 1;
+        if (rank > n) rank = n;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBuckets; i++) {
+            seen += counts_[i].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                uint64_t hi = bucket_upper(i);
+                return hi < max() ? hi : max();
+            }
+        }
+        return max();
+    }
+
+private:
+    static size_t bucket_of(uint64_t v) {
+        if (v < kSub) return (size_t)v;
+        int msb = 63 - __builtin_clzll(v);
+        int shift = msb - (kSubBits - 1);
+        uint64_t mant = v >> shift;
+        return (size_t)(kSub + (uint64_t)(shift - 1) * kHalf + (mant - kHalf));
+    }
+
+    static uint64_t bucket_upper(size_t i) {
+        if (i < kSub) return i;
+        uint64_t shift = (i - kSub) / kHalf + 1;
+        uint64_t mant = (i - kSub) % kHalf + kHalf;
+        return ((mant + 1) << shift) - 1;
+    }
+
+    std::unique_ptr<std::atomic<uint64_t>[]> counts_;
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+    std::atomic<uint64_t> min_{UINT64_MAX};
+    std::atomic<uint64_t> max_{0};
+};
+
+class Timer {
+public:
+    Timer() : t0_(std::chrono::steady_clock::now()) {}
+    void reset() { t0_ = std::chrono::steady_clock::now(); }
+    double seconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0_).count();
+    }
+    uint64_t us() const {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - t0_).count();
+    }
+    uint64_t ns() const {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - t0_).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point t0_;
+};
+
+class Registry {
+public:
+    explicit Registry(std::string tool) : tool_(std::move(tool)) {}
+
+    const std::string& tool() const { return tool_; }
+
+    Counter& counter(const std::string& name, const std::string& help = "") {
+        return get(counters_, name, help);
+    }
+    Gauge& gauge(const std::string& name, const std::string& help = "") {
+        return get(gauges_, name, help);
+    }
+    Histogram& histogram(const std::string& name, const std::string& help = "") {
+        return get(histograms_, name, help);
+    }
+
+    std::string to_json() const {
+        std::ostringstream o;
+        o << std::setprecision(10);
+        o << "{\"tool\":\"" << tool_ << "\",\"timestamp\":" << (long long)std::time(nullptr);
+        o << ",\"counters\":{";
+        bool first = true;
+        for (const auto& [name, e] : counters_) {
+            o << (first ? "" : ",") << "\"" << name << "\":" << e.metric->value();
+            first = false;
+        }
+        o << "},\"gauges\":{";
+        first = true;
+        for (const auto& [name, e] : gauges_) {
+            o << (first ? "" : ",") << "\"" << name << "\":" << json_number(e.metric->value());
+            first = false;
+        }
+        o << "},\"histograms\":{";
+        first = true;
+        for (const auto& [name, e] : histograms_) {
+            const Histogram& h = *e.metric;
+            o << (first ? "" : ",") << "\"" << name << "\":{"
+              << "\"count\":" << h.count() << ",\"sum\":" << h.sum()
+              << ",\"min\":" << h.min() << ",\"max\":" << h.max()
+              << ",\"mean\":" << json_number(h.mean())
+              << ",\"p50\":" << h.percentile(0.50) << ",\"p90\":" << h.percentile(0.90)
+              << ",\"p99\":" << h.percentile(0.99) << ",\"p999\":" << h.percentile(0.999) << "}";
+            first = false;
+        }
+        o << "}}";
+        return o.str();
+    }
+
+    // Гистограммы экспортируются как summary с квантилями из HDR-корзин.
+    std::string to_prometheus() const {
+        std::ostringstream o;
+        o << std::setprecision(10);
+        for (const auto& [name, e] : counters_) {
+            const std::string full = tool_ + "_" + name;
+            header(o, full, e.help, "counter");
+            o << full << " " << e.metric->value() << "\n";
+        }
+        for (const auto& [name, e] : gauges_) {
+            const std::string full = tool_ + "_" + name;
+            header(o, full, e.help, "gauge");
+            o << full << " " << e.metric->value() << "\n";
+        }
+        for (const auto& [name, e] : histograms_) {
+            const std::string full = tool_ + "_" + name;
+            const Histogram& h = *e.metric;
+            header(o, full, e.help, "summary");
+            for (double q : {0.5, 0.9, 0.99, 0.999}) {
+                o << full << "{quantile=\"" << q << "\"} " << h.percentile(q) << "\n";
+            }
+            o << full << "_sum " << h.sum() << "\n";
+            o << full << "_count " << h.count() << "\n";
+        }
+        return o.str();
+    }
+
+private:
+    template <typename T>
+    struct Entry {
+        std::string help;
+        std::unique_ptr<T> metric;
+    };
+
+    template <typename T>
+    T& get(std::map<std::string, Entry<T>>& m, const std::string& name, const std::string& help) {
+        auto it = m.find(name);
+        if (it == m.end()) {
+            it = m.emplace(name, Entry<T>{help, std::make_unique<T>()}).first;
+        }
+        return *it->second.metric;
+    }
+
+    static std::string json_number(double v) {
+        if (v != v || v == 1.0 / 0.0 || v == -1.0 / 0.0) return "null";
+        std::ostringstream o;
+        o << std::setprecision(10) << v;
+        return o.str();
+    }
+
+    static void header(std::ostringstream& o, const std::string& name, const std::string& help, const char* type) {
+        if (!help.empty()) o << "# HELP " << name << " " << help << "\n";
+        o << "# TYPE " << name << " " << type << "\n";
+    }
+
+    std::string tool_;
+    std::map<std::string, Entry<Counter>> counters_;
+    std::map<std::string, Entry<Gauge>> gauges_;
+    std::map<std::string, Entry<Histogram>> histograms_;
+};
+
+// Каталог для выгрузки задается переменной METRICS_DIR (по умолчанию data/metrics).
+inline std::filesystem::path metrics_dir() {
+    const char* env = std::getenv("METRICS_DIR");
+    return (env && *env) ? std::filesystem::path(env) : std::filesystem::path("data/metrics");
+}
+
+// Пишет <tool>.json с последним прогоном и дописывает строку в <tool>.jsonl,
+// чтобы по истории ночных прогонов можно было строить тренды.
+inline bool dump_json(const Registry& reg) {
+    const std::filesystem::path dir = metrics_dir();
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+
+    const std::string json = reg.to_json();
+    std::ofstream last(dir / (reg.tool() + ".json"), std::ios::binary);
+    std::ofstream hist(dir / (reg.tool() + ".jsonl"), std::ios::binary | std::ios::app);
+    if (!last || !hist) return false;
+    last << json << "\n";
+    hist << json << "\n";
+    return true;
+}
+
+inline bool dump_prometheus(const Registry& reg, const std::filesystem::path& path) {
+    std::error_code ec;
+    if (path.has_parent_path()) std::filesystem::create_directories(path.parent_path(), ec);
+    std::ofstream out(path, std::ios::binary);
+    if (!out) return false;
+    out << reg.to_prometheus();
+    return true;
+}
+
+}  // namespace metrics
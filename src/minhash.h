@@ -0,0 +1,201 @@
+#pragma once
+
+// MinHash-сигнатуры документов и поиск почти-дубликатов через LSH.
+// Сигнатура считается в токенизаторе по шинглам из kShingleSize подряд
+// идущих токенов и сохраняется в minhash.bin:
+//   "MHS1", uint32 K, далее записи:
+//   uint16 len, doc_id, uint32 число токенов, K x uint32 минимумов.
+// Индексатор режет сигнатуру на полосы (bands x rows = K), документы с
+// совпавшей полосой проверяются по оценке сходства Жаккара и объединяются
+// в кластеры (union-find).
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+static constexpr uint32_t kMinHashSize = 128;
+static constexpr size_t kShingleSize = 3;
+static constexpr char kMinHashMagic[4] = {'M', 'H', 'S', '1'};
+
+inline uint64_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+template <typename Str>
+inline uint64_t hash_token(const Str& s) {
+    uint64_t h = 1469598103934665603ULL;
+    for (auto c : s) {
+        h ^= (uint64_t)(uint32_t)c;
+        h *= 1099511628211ULL;
+    }
+    return mix64(h);
+}
+
+struct MinHashSignature {
+    std::string doc_id;
+    uint32_t tokens = 0;
+    std::vector<uint32_t> mins;
+};
+
+// Сигнатура по хешам токенов документа (в порядке следования).
+inline void compute_minhash(const std::vector<uint64_t>& token_hashes, std::vector<uint32_t>& mins) {
+    mins.assign(kMinHashSize, UINT32_MAX);
+    if (token_hashes.empty()) return;
+
+    const size_t n = token_hashes.size();
+    const size_t shingles = n >= kShingleSize ? n - kShingleSize + 1 : 1;
+    for (size_t i = 0; i < shingles; i++) {
+        uint64_t sh = 0;
+        for (size_t j = 0; j < kShingleSize && i + j < n; j++) {
+            sh ^= rotl64(token_hashes[i + j], (int)(j * 21 + 1));
+        }
+        sh = mix64(sh);
+        for (uint32_t k = 0; k < kMinHashSize; k++) {
+            const uint32_t v = (uint32_t)mix64(sh + 0x9e3779b97f4a7c15ULL * (k + 1));
+            if (v < mins[k]) mins[k] = v;
+        }
+    }
+}
+
+inline double minhash_similarity(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b) {
+    uint32_t eq = 0;
+    for (size_t i = 0; i < a.size(); i++) eq += (a[i] == b[i]);
+    return a.empty() ? 0.0 : (double)eq / (double)a.size();
+}
+
+class MinHashWriter {
+public:
+    bool open(const std::string& path) {
+        out_.open(path, std::ios::binary);
+        if (!out_) return false;
+        out_.write(kMinHashMagic, sizeof(kMinHashMagic));
+        const uint32_t k = kMinHashSize;
+        out_.write(reinterpret_cast<const char*>(&k), sizeof(k));
+        return (bool)out_;
+    }
+
+    bool is_open() const { return out_.is_open(); }
+
+    void write(std::string_view doc_id, uint32_t tokens, const std::vector<uint32_t>& mins) {
+        const uint16_t len = (uint16_t)std::min<size_t>(doc_id.size(), UINT16_MAX);
+        out_.write(reinterpret_cast<const char*>(&len), sizeof(len));
+        out_.write(doc_id.data(), len);
+        out_.write(reinterpret_cast<const char*>(&tokens), sizeof(tokens));
+        out_.write(reinterpret_cast<const char*>(mins.data()), mins.size() * sizeof(uint32_t));
+    }
+
+private:
+    std::ofstream out_;
+};
+
+inline bool load_minhash(const std::string& path, std::vector<MinHashSignature>& sigs) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    char magic[4];
+    uint32_t k = 0;
+    in.read(magic, sizeof(magic));
+    in.read(reinterpret_cast<char*>(&k), sizeof(k));
+    if (!in || std::memcmp(magic, kMinHashMagic, sizeof(magic)) != 0 || k == 0) return false;
+
+    for (;;) {
+        uint16_t len = 0;
+        in.read(reinterpret_cast<char*>(&len), sizeof(len));
+        if (!in) break;
+        MinHashSignature s;
+        s.doc_id.resize(len);
+        in.read(&s.doc_id[0], len);
+        in.read(reinterpret_cast<char*>(&s.tokens), sizeof(s.tokens));
+        s.mins.resize(k);
+        in.read(reinterpret_cast<char*>(s.mins.data()), k * sizeof(uint32_t));
+        if (!in) return false;
+        sigs.push_back(std::move(s));
+    }
+    return true;
+}
+
+struct DuplicateCluster {
+    size_t representative;          // индекс в векторе сигнатур
+    std::vector<size_t> members;    // без представителя
+    std::vector<double> similarity; // оценка Жаккара члена с представителем
+};
+
+// Кластеры почти-дубликатов. Представитель кластера - самый длинный документ.
+inline std::vector<DuplicateCluster> find_near_duplicates(
+    const std::vector<MinHashSignature>& sigs, uint32_t bands, double threshold
+) {
+    const uint32_t rows = kMinHashSize / bands;
+    std::vector<size_t> parent(sigs.size());
+    for (size_t i = 0; i < parent.size(); i++) parent[i] = i;
+    auto find = [&](size_t x) {
+        while (parent[x] != x) {
+            parent[x] = parent[parent[x]];
+            x = parent[x];
+        }
+        return x;
+    };
+
+    // Сравнение внутри корзины ограничено, чтобы вырожденные корзины не давали O(n^2).
+    const size_t kMaxCompare = 64;
+    std::unordered_map<uint64_t, std::vector<size_t>> buckets;
+    for (uint32_t b = 0; b < bands; b++) {
+        buckets.clear();
+        for (size_t i = 0; i < sigs.size(); i++) {
+            if (sigs[i].tokens == 0 || sigs[i].mins.size() != kMinHashSize) continue;
+            uint64_t h = mix64(b + 1);
+            for (uint32_t r = 0; r < rows; r++) {
+                h = mix64(h ^ sigs[i].mins[b * rows + r]);
+            }
+            auto& bucket = buckets[h];
+            for (size_t j = 0; j < bucket.size() && j < kMaxCompare; j++) {
+                const size_t other = bucket[j];
+                if (find(other) == find(i)) break;
+                if (minhash_similarity(sigs[i].mins, sigs[other].mins) >= threshold) {
+                    parent[find(i)] = find(other);
+                    break;
+                }
+            }
+            bucket.push_back(i);
+        }
+    }
+
+    std::unordered_map<size_t, std::vector<size_t>> groups;
+    for (size_t i = 0; i < sigs.size(); i++) {
+        groups[find(i)].push_back(i);
+    }
+
+    std::vector<DuplicateCluster> clusters;
+    for (auto& [root, docs] : groups) {
+        if (docs.size() < 2) continue;
+        std::sort(docs.begin(), docs.end());
+        size_t rep = docs[0];
+        for (size_t d : docs) {
+            if (sigs[d].tokens > sigs[rep].tokens) rep = d;
+        }
+        DuplicateCluster c;
+        c.representative = rep;
+        for (size_t d : docs) {
+            if (d == rep) continue;
+            c.members.push_back(d);
+            c.similarity.push_back(minhash_similarity(sigs[d].mins, sigs[rep].mins));
+        }
+        clusters.push_back(std::move(c));
+    }
+    std::sort(clusters.begin(), clusters.end(), [](const DuplicateCluster& a, const DuplicateCluster& b) {
+        return a.representative < b.representative;
+    });
+    return clusters;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+// Файл, отображенный в память только для чтения (RAII-обертка над mmap).
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& o) noexcept { swap(o); }
+    MappedFile& operator=(MappedFile&& o) noexcept { close(); swap(o); return *this; }
+    ~MappedFile() { close(); }
+
+    // sequential = true подсказывает ядру читать файл вперед (пакетные проходы),
+    // иначе ожидается случайный доступ (поиск по индексу).
+    bool open(const std::string& path, bool sequential = true) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0) { ::close(fd); return false; }
+        size_ = (size_t)st.st_size;
+        if (size_ > 0) {
+            void* p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) { ::close(fd); size_ = 0; return false; }
+            data_ = static_cast<const char*>(p);
+            madvise(p, size_, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+        }
+        ::close(fd);
+        open_ = true;
+        return true;
+    }
+
+    void close() {
+        if (data_) munmap(const_cast<char*>(data_), size_);
+        data_ = nullptr;
+        size_ = 0;
+        open_ = false;
+    }
+
+    bool is_open() const { return open_; }
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    void swap(MappedFile& o) {
+        std::swap(data_, o.data_);
+        std::swap(size_, o.size_);
+        std::swap(open_, o.open_);
+    }
+
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    bool open_ = false;
+};
@@ -0,0 +1,259 @@
+#pragma once
+
+// Минимальная совершенная хеш-функция термов (схема BBHash) для поиска id
+// терма по строке без двоичного поиска по словарю.
+// Уровень l - битовый массив размера gamma * (ключей на уровне); ключ ставит
+// бит по своему хешу уровня, бит без коллизий остается за ним, ключи с
+// коллизией переходят на следующий уровень. Номер ключа - ранг его бита во
+// всех уровнях подряд, ранг считается по таблице на каждые 512 бит.
+// Оставшиеся после kMphfMaxLevels уровней ключи лежат в отсортированном
+// массиве хешей. Слот хранит id терма и отпечаток (старшие 32 бита хеша):
+// терм не из словаря почти всегда отсекается отпечатком, не дойдя до строки.
+//
+// data/term_hash.bin:
+//   "MPH1", uint32 n ключей, uint32 уровней L, uint32 запасных R,
+//   L x (uint64 первый бит уровня, uint64 размер уровня в битах),
+//   uint64 W, W x uint64 слов битовых массивов, (W / 8 + 1) x uint32 рангов,
+//   R x (uint64 хеш, uint32 слот, uint32 0),
+//   n x (uint32 id терма, uint32 отпечаток)
+//
+// Уровни строятся параллельно: ключи делятся между потоками, биты ставятся
+// атомарным fetch_or.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "minhash.h"
+#include "mmap_file.h"
+#include "parallel.h"
+
+static constexpr char kMphfMagic[4] = {'M', 'P', 'H', '1'};
+static constexpr uint32_t kMphfMaxLevels = 24;
+static constexpr uint32_t kMphfRankWords = 8;
+
+inline uint64_t mphf_level_hash(uint64_t h, uint32_t level) {
+    return mix64(h + 0x9E3779B97F4A7C15ULL * (level + 1));
+}
+
+inline uint32_t mphf_fingerprint(uint64_t h) {
+    return (uint32_t)(h >> 32);
+}
+
+struct MphfBuildStats {
+    uint32_t levels = 0;
+    uint64_t fallback = 0;
+    uint64_t bytes = 0;
+};
+
+// terms[id] - строка терма с этим id; gamma >= 1 - запас размера уровня.
+inline bool write_term_hash(const std::vector<std::string_view>& terms, const std::string& filename, double gamma,
+                            unsigned threads, MphfBuildStats* stats = nullptr) {
+    const size_t n = terms.size();
+    std::vector<uint64_t> hashes(n);
+    parallel_ranges(n, threads, [&](size_t from, size_t to, unsigned) {
+        for (size_t i = from; i < to; i++) hashes[i] = hash_token(terms[i]);
+    });
+
+    std::vector<uint32_t> keys(n);
+    for (uint32_t i = 0; i < n; i++) keys[i] = i;
+    std::vector<uint64_t> level_start, level_bits, words;
+    std::vector<std::vector<uint32_t>> next(std::max(1u, threads));
+
+    while (!keys.empty() && level_start.size() < kMphfMaxLevels) {
+        const uint32_t level = (uint32_t)level_start.size();
+        const uint64_t bits = std::max<uint64_t>(64, ((uint64_t)(keys.size() * gamma) + 63) / 64 * 64);
+        const size_t nw = (size_t)(bits / 64);
+        std::unique_ptr<std::atomic<uint64_t>[]> set(new std::atomic<uint64_t>[nw]);
+        std::unique_ptr<std::atomic<uint64_t>[]> collide(new std::atomic<uint64_t>[nw]);
+        for (size_t w = 0; w < nw; w++) {
+            set[w].store(0, std::memory_order_relaxed);
+            collide[w].store(0, std::memory_order_relaxed);
+        }
+        auto pos = [&](uint32_t k) { return mphf_level_hash(hashes[k], level) % bits; };
+
+        parallel_ranges(keys.size(), threads, [&](size_t from, size_t to, unsigned) {
+            for (size_t i = from; i < to; i++) {
+                const uint64_t p = pos(keys[i]);
+                const uint64_t bit = 1ULL << (p & 63);
+                if (set[p >> 6].fetch_or(bit, std::memory_order_relaxed) & bit) {
+                    collide[p >> 6].fetch_or(bit, std::memory_order_relaxed);
+                }
+            }
+        });
+        for (auto& v : next) v.clear();
+        parallel_ranges(keys.size(), threads, [&](size_t from, size_t to, unsigned t) {
+            for (size_t i = from; i < to; i++) {
+                const uint64_t p = pos(keys[i]);
+                if (collide[p >> 6].load(std::memory_order_relaxed) & (1ULL << (p & 63))) next[t].push_back(keys[i]);
+            }
+        });
+
+        level_start.push_back(words.size() * 64);
+        level_bits.push_back(bits);
+        for (size_t w = 0; w < nw; w++) words.push_back(set[w].load() & ~collide[w].load());
+        keys.clear();
+        for (const auto& v : next) keys.insert(keys.end(), v.begin(), v.end());
+    }
+
+    std::vector<uint32_t> ranks(words.size() / kMphfRankWords + 1);
+    uint32_t acc = 0;
+    for (size_t w = 0; w < words.size(); w++) {
+        if (w % kMphfRankWords == 0) ranks[w / kMphfRankWords] = acc;
+        acc += (uint32_t)__builtin_popcountll(words[w]);
+    }
+
+    // Слоты: сначала ключи уровней (по рангу бита), затем запасные.
+    std::vector<uint32_t> slots(2 * n, 0);
+    auto slot_of = [&](uint32_t k) -> int64_t {
+        for (uint32_t l = 0; l < level_start.size(); l++) {
+            const uint64_t b = level_start[l] + mphf_level_hash(hashes[k], l) % level_bits[l];
+            const uint64_t w = words[b >> 6];
+            if (!(w & (1ULL << (b & 63)))) continue;
+            uint32_t r = ranks[(b >> 6) / kMphfRankWords];
+            for (size_t i = (b >> 6) / kMphfRankWords * kMphfRankWords; i < (b >> 6); i++) r += (uint32_t)__builtin_popcountll(words[i]);
+            return r + (uint32_t)__builtin_popcountll(w & ((1ULL << (b & 63)) - 1));
+        }
+        return -1;
+    };
+    // Запасные ключи (хеш, ключ) по возрастанию хеша; их слоты - после уровней.
+    std::vector<std::pair<uint64_t, uint32_t>> fallback;
+    for (uint32_t k : keys) fallback.emplace_back(hashes[k], k);
+    std::sort(fallback.begin(), fallback.end());
+    parallel_ranges(n, threads, [&](size_t from, size_t to, unsigned) {
+        for (size_t k = from; k < to; k++) {
+            int64_t s = slot_of((uint32_t)k);
+            if (s < 0) continue;
+            slots[2 * s] = (uint32_t)k;
+            slots[2 * s + 1] = mphf_fingerprint(hashes[k]);
+        }
+    });
+    for (size_t i = 0; i < fallback.size(); i++) {
+        slots[2 * (acc + i)] = fallback[i].second;
+        slots[2 * (acc + i) + 1] = mphf_fingerprint(fallback[i].first);
+    }
+
+    std::ofstream out(filename, std::ios::binary);
+    if (!out) return false;
+    const uint32_t head[3] = {(uint32_t)n, (uint32_t)level_start.size(), (uint32_t)fallback.size()};
+    out.write(kMphfMagic, sizeof(kMphfMagic));
+    out.write(reinterpret_cast<const char*>(head), sizeof(head));
+    for (size_t l = 0; l < level_start.size(); l++) {
+        out.write(reinterpret_cast<const char*>(&level_start[l]), sizeof(uint64_t));
+        out.write(reinterpret_cast<const char*>(&level_bits[l]), sizeof(uint64_t));
+    }
+    const uint64_t nw = words.size();
+    out.write(reinterpret_cast<const char*>(&nw), sizeof(nw));
+    out.write(reinterpret_cast<const char*>(words.data()), words.size() * sizeof(uint64_t));
+    out.write(reinterpret_cast<const char*>(ranks.data()), ranks.size() * sizeof(uint32_t));
+    for (size_t i = 0; i < fallback.size(); i++) {
+        const uint32_t tail[2] = {acc + (uint32_t)i, 0};
+        out.write(reinterpret_cast<const char*>(&fallback[i].first), sizeof(uint64_t));
+        out.write(reinterpret_cast<const char*>(tail), sizeof(tail));
+    }
+    out.write(reinterpret_cast<const char*>(slots.data()), slots.size() * sizeof(uint32_t));
+    if (stats) {
+        stats->levels = (uint32_t)level_start.size();
+        stats->fallback = fallback.size();
+        stats->bytes = (uint64_t)out.tellp();
+    }
+    return (bool)out;
+}
+
+class TermHash {
+public:
+    bool open(const std::string& path) {
+        if (!file_.open(path, false) || file_.size() < 16) return false;
+        const char* p = file_.data();
+        if (std::memcmp(p, kMphfMagic, sizeof(kMphfMagic)) != 0) return false;
+        std::memcpy(&n_, p + 4, 4);
+        std::memcpy(&levels_, p + 8, 4);
+        std::memcpy(&fallback_n_, p + 12, 4);
+        if (levels_ > kMphfMaxLevels) return false;
+        size_t at = 16;
+        for (uint32_t l = 0; l < levels_; l++) {
+            std::memcpy(&start_[l], p + at, 8);
+            std::memcpy(&bits_[l], p + at + 8, 8);
+            at += 16;
+        }
+        uint64_t nw = 0;
+        std::memcpy(&nw, p + at, 8);
+        at += 8;
+        const size_t need = at + nw * 8 + (nw / kMphfRankWords + 1) * 4 + (size_t)fallback_n_ * 16 + (size_t)n_ * 8;
+        if (file_.size() < need) return false;
+        words_ = reinterpret_cast<const uint64_t*>(p + at);
+        at += nw * 8;
+        ranks_ = reinterpret_cast<const uint32_t*>(p + at);
+        at += (nw / kMphfRankWords + 1) * 4;
+        fallback_ = p + at;
+        at += (size_t)fallback_n_ * 16;
+        slots_ = reinterpret_cast<const uint32_t*>(p + at);
+        return true;
+    }
+
+    bool is_open() const { return slots_ != nullptr; }
+    uint32_t size() const { return n_; }
+    uint64_t bytes() const { return file_.size(); }
+    // Биты самой функции (уровни и ранги) на ключ, без таблицы слотов.
+    double bits_per_key() const {
+        if (!n_) return 0.0;
+        const uint64_t nw = levels_ ? (start_[levels_ - 1] + bits_[levels_ - 1]) / 64 : 0;
+        return (double)(nw * 64 + (nw / kMphfRankWords + 1) * 32) / n_;
+    }
+
+    // id терма-кандидата; -1 - терма точно нет. Кандидат с совпавшим
+    // отпечатком надо сверить со строкой словаря.
+    int64_t candidate(std::string_view term) const { return candidate(hash_token(term)); }
+
+    // То же по уже посчитанному hash_token(терм).
+    int64_t candidate(uint64_t h) const {
+        if (!is_open() || n_ == 0) return -1;
+        int64_t slot = -1;
+        for (uint32_t l = 0; l < levels_ && slot < 0; l++) {
+            const uint64_t b = start_[l] + mphf_level_hash(h, l) % bits_[l];
+            const uint64_t w = words_[b >> 6];
+            if (!(w & (1ULL << (b & 63)))) continue;
+            const size_t wi = (size_t)(b >> 6);
+            uint32_t r = ranks_[wi / kMphfRankWords];
+            for (size_t i = wi / kMphfRankWords * kMphfRankWords; i < wi; i++) r += (uint32_t)__builtin_popcountll(words_[i]);
+            slot = r + (uint32_t)__builtin_popcountll(w & ((1ULL << (b & 63)) - 1));
+        }
+        if (slot < 0) {
+            // Запасные ключи: двоичный поиск по хешу.
+            uint32_t lo = 0, hi = fallback_n_;
+            while (lo < hi) {
+                const uint32_t mid = (lo + hi) / 2;
+                uint64_t fh;
+                std::memcpy(&fh, fallback_ + (size_t)mid * 16, 8);
+                if (fh < h) lo = mid + 1;
+                else hi = mid;
+            }
+            uint64_t fh = 0;
+            if (lo < fallback_n_) std::memcpy(&fh, fallback_ + (size_t)lo * 16, 8);
+            if (lo == fallback_n_ || fh != h) return -1;
+            uint32_t s;
+            std::memcpy(&s, fallback_ + (size_t)lo * 16 + 8, 4);
+            slot = s;
+        }
+        if (slots_[2 * slot + 1] != mphf_fingerprint(h)) return -1;
+        return slots_[2 * slot];
+    }
+
+private:
+    MappedFile file_;
+    uint32_t n_ = 0;
+    uint32_t levels_ = 0;
+    uint32_t fallback_n_ = 0;
+    uint64_t start_[kMphfMaxLevels] = {};
+    uint64_t bits_[kMphfMaxLevels] = {};
+    const uint64_t* words_ = nullptr;
+    const uint32_t* ranks_ = nullptr;
+    const char* fallback_ = nullptr;
+    const uint32_t* slots_ = nullptr;
+};
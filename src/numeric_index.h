@@ -0,0 +1,99 @@
+#pragma once
+
+// Числовой индекс для запросов range:[a TO b].
+// Токенизатор выписывает числа из текста в numbers.tsv (doc_id \t pos \t
+// значение), индексатор сортирует пары (значение, документ) и пишет
+// data/numeric_index.bin:
+//   "NUM1", uint32 0, uint64 V различных значений, uint64 P пар,
+//   V x uint64 значений по возрастанию,
+//   (V + 1) x uint64 смещений в массиве документов,
+//   P x uint32 документов: для каждого значения - по возрастанию, без повторов.
+// Границы диапазона ищутся по дереву Эйтцингера над значениями
+// (static_tree.h), документы диапазона лежат в массиве подряд и собираются
+// в битовое множество.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "bitmap.h"
+#include "mmap_file.h"
+#include "static_tree.h"
+
+static constexpr char kNumericMagic[4] = {'N', 'U', 'M', '1'};
+
+// pairs портится (сортируется).
+inline bool write_numeric_index(std::vector<std::pair<uint64_t, uint32_t>>& pairs, const std::string& filename) {
+    std::sort(pairs.begin(), pairs.end());
+    pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+
+    std::vector<uint64_t> values;
+    std::vector<uint64_t> offsets;
+    std::vector<uint32_t> docs;
+    docs.reserve(pairs.size());
+    for (size_t i = 0; i < pairs.size(); i++) {
+        if (i == 0 || pairs[i].first != pairs[i - 1].first) {
+            values.push_back(pairs[i].first);
+            offsets.push_back(docs.size());
+        }
+        docs.push_back(pairs[i].second);
+    }
+    offsets.push_back(docs.size());
+
+    std::ofstream out(filename, std::ios::binary);
+    if (!out) return false;
+    const uint32_t reserved = 0;
+    const uint64_t nv = values.size(), np = docs.size();
+    out.write(kNumericMagic, sizeof(kNumericMagic));
+    out.write(reinterpret_cast<const char*>(&reserved), sizeof(reserved));
+    out.write(reinterpret_cast<const char*>(&nv), sizeof(nv));
+    out.write(reinterpret_cast<const char*>(&np), sizeof(np));
+    out.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(uint64_t));
+    out.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+    out.write(reinterpret_cast<const char*>(docs.data()), docs.size() * sizeof(uint32_t));
+    return (bool)out;
+}
+
+class NumericIndex {
+public:
+    bool open(const std::string& path) {
+        if (!file_.open(path, false) || file_.size() < 24) return false;
+        if (std::memcmp(file_.data(), kNumericMagic, sizeof(kNumericMagic)) != 0) return false;
+        std::memcpy(&num_values_, file_.data() + 8, sizeof(num_values_));
+        std::memcpy(&num_pairs_, file_.data() + 16, sizeof(num_pairs_));
+        const size_t need = 24 + num_values_ * 8 + (num_values_ + 1) * 8 + num_pairs_ * 4;
+        if (file_.size() < need) return false;
+        values_ = reinterpret_cast<const uint64_t*>(file_.data() + 24);
+        offsets_ = values_ + num_values_;
+        docs_ = reinterpret_cast<const uint32_t*>(offsets_ + num_values_ + 1);
+        tree_.build(values_, num_values_);
+        return true;
+    }
+
+    bool is_open() const { return values_ != nullptr; }
+    uint64_t num_values() const { return num_values_; }
+    uint64_t num_pairs() const { return num_pairs_; }
+
+    // Документы, в которых встречается число из [lo, hi].
+    void range(uint64_t lo, uint64_t hi, DocBitmap& out) const {
+        if (!is_open() || lo > hi) return;
+        const uint64_t from = offsets_[tree_.lower_bound(lo)];
+        const uint64_t to = offsets_[hi == UINT64_MAX ? num_values_ : tree_.lower_bound(hi + 1)];
+        for (uint64_t i = from; i < to; i++) {
+            if (docs_[i] < out.size()) out.set(docs_[i]);
+        }
+    }
+
+private:
+    MappedFile file_;
+    uint64_t num_values_ = 0;
+    uint64_t num_pairs_ = 0;
+    const uint64_t* values_ = nullptr;
+    const uint64_t* offsets_ = nullptr;
+    const uint32_t* docs_ = nullptr;
+    EytzingerTree tree_;
+};
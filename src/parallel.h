@@ -0,0 +1,27 @@
+#pragma once
+
+// Разбиение работы между потоками для построения индекса.
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Вызывает fn(from, to, t) для threads поддиапазонов [from, to) из [0, n),
+// поток t получает t-й кусок; при малом n - один вызов в текущем потоке.
+// Разбиение зависит только от n и threads, поэтому повторные проходы по тем
+// же данным дают потоку те же куски.
+template <typename Fn>
+inline void parallel_ranges(size_t n, unsigned threads, Fn fn) {
+    if (threads <= 1 || n < 4096) {
+        fn(0, n, 0u);
+        return;
+    }
+    std::vector<std::thread> pool;
+    const size_t chunk = (n + threads - 1) / threads;
+    for (unsigned t = 0; t < threads; t++) {
+        const size_t from = std::min(n, t * chunk), to = std::min(n, from + chunk);
+        pool.emplace_back(fn, from, to, t);
+    }
+    for (auto& th : pool) th.join();
+}
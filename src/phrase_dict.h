@@ -0,0 +1,142 @@
+#pragma once
+
+// Словарь устойчивых словосочетаний (биноминальные латинские названия вроде
+// "Homo sapiens", многословные термины). Фразы компилируются в автомат
+// Ахо-Корасик над токенами: алфавит - слова словаря, поэтому поток токенов
+// документа проходится один раз, сколько бы фраз ни было в словаре.
+// Найденная фраза выдается токенизатором как отдельный терм на позиции
+// первого слова: слова через kPhraseJoiner ("homo_sapiens"). Стеммер
+// нормализует каждое слово терма отдельно, и запрос "homo sapiens" в кавычках
+// превращается в поиск одного терма вместо позиционного пересечения.
+//
+// Формат файла: одна фраза на строку, '#' - комментарий. Фраза разбивается
+// на токены tokenize_text; фразы из одного слова и с числами пропускаются.
+
+#include <fstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "text_ru.h"
+
+class PhraseDict {
+public:
+    struct Match {
+        size_t start;    // индекс первого токена фразы
+        uint32_t phrase;
+    };
+
+    bool load(const std::string& path) {
+        std::ifstream in(path);
+        if (!in) return false;
+        std::string line;
+        std::vector<std::wstring> tokens;
+        std::vector<uint32_t> positions;
+        while (std::getline(in, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            const size_t hash = line.find('#');
+            if (hash != std::string::npos) line.erase(hash);
+            try {
+                tokenize_text(utf8_to_wstring(line), tokens, positions);
+            } catch (...) {
+                continue;
+            }
+            add(tokens);
+        }
+        build();
+        return true;
+    }
+
+    // Фраза из уже разбитых токенов; после добавления всех фраз - build().
+    bool add(const std::vector<std::wstring>& tokens) {
+        if (tokens.size() < 2) return false;
+        for (const auto& t : tokens) {
+            if (is_digit(t[0])) return false;
+        }
+        if (nodes_.empty()) nodes_.emplace_back();
+        uint32_t s = 0;
+        for (const auto& t : tokens) {
+            const uint32_t sym = symbols_.emplace(t, (uint32_t)symbols_.size()).first->second;
+            const uint64_t key = edge_key(s, sym);
+            auto it = edges_.find(key);
+            if (it == edges_.end()) {
+                nodes_.emplace_back();
+                nodes_.back().depth = nodes_[s].depth + 1;
+                it = edges_.emplace(key, (uint32_t)nodes_.size() - 1).first;
+            }
+            s = it->second;
+        }
+        if (nodes_[s].phrase >= 0) return false;
+        std::wstring text = tokens[0];
+        for (size_t i = 1; i < tokens.size(); i++) {
+            text.push_back(kPhraseJoiner);
+            text += tokens[i];
+        }
+        nodes_[s].phrase = (int32_t)phrases_.size();
+        phrases_.push_back(std::move(text));
+        return true;
+    }
+
+    // Ссылки неудач и выходов считаются обходом бора в ширину.
+    void build() {
+        if (nodes_.empty()) return;
+        std::vector<std::vector<std::pair<uint32_t, uint32_t>>> children(nodes_.size());
+        for (const auto& [key, to] : edges_) children[key >> 32].emplace_back((uint32_t)key, to);
+        std::vector<uint32_t> queue;
+        for (const auto& [sym, to] : children[0]) {
+            nodes_[to].fail = 0;
+            queue.push_back(to);
+        }
+        for (size_t head = 0; head < queue.size(); head++) {
+            const uint32_t s = queue[head];
+            const uint32_t f = nodes_[s].fail;
+            nodes_[s].out = nodes_[f].phrase >= 0 ? f : nodes_[f].out;
+            for (const auto& [sym, to] : children[s]) {
+                nodes_[to].fail = step(f, sym);
+                queue.push_back(to);
+            }
+        }
+    }
+
+    // Все вхождения фраз в последовательность токенов, по возрастанию конца.
+    void match(const std::vector<std::wstring>& tokens, std::vector<Match>& out) const {
+        out.clear();
+        if (phrases_.empty()) return;
+        uint32_t s = 0;
+        for (size_t i = 0; i < tokens.size(); i++) {
+            auto sym = symbols_.find(tokens[i]);
+            s = sym == symbols_.end() ? 0 : step(s, sym->second);
+            for (uint32_t o = nodes_[s].phrase >= 0 ? s : nodes_[s].out; o != 0; o = nodes_[o].out) {
+                out.push_back({i + 1 - nodes_[o].depth, (uint32_t)nodes_[o].phrase});
+            }
+        }
+    }
+
+    size_t size() const { return phrases_.size(); }
+    const std::wstring& text(uint32_t phrase) const { return phrases_[phrase]; }
+
+private:
+    struct Node {
+        uint32_t fail = 0;
+        uint32_t out = 0;     // ближайший по ссылкам неудач узел с фразой (0 - нет)
+        uint32_t depth = 0;
+        int32_t phrase = -1;
+    };
+
+    static uint64_t edge_key(uint32_t s, uint32_t sym) { return ((uint64_t)s << 32) | sym; }
+
+    uint32_t step(uint32_t s, uint32_t sym) const {
+        for (;;) {
+            auto it = edges_.find(edge_key(s, sym));
+            if (it != edges_.end()) return it->second;
+            if (s == 0) return 0;
+            s = nodes_[s].fail;
+        }
+    }
+
+    std::vector<Node> nodes_;
+    std::unordered_map<uint64_t, uint32_t> edges_;
+    std::unordered_map<std::wstring, uint32_t> symbols_;
+    std::vector<std::wstring> phrases_;
+};
@@ -0,0 +1,535 @@
+#pragma once
+
+// Блочный формат списков словопозиций и итератор по нему.
+// Список терма с df документами хранится как
+//   таблица пропусков: nb x (uint32 последний doc блока, uint32 конец блока в байтах от начала данных)
+//   данные: для каждого блока секция doc (до kBlockSize doc в кодеке списка),
+//           затем столько же tf (varint),
+//           затем, если в индексе есть квантованные вклады, столько же
+//           вкладов фиксированной ширины (1 или 2 байта, little-endian),
+//           затем, если в индексе есть позиции, для каждого постинга
+//           tf разностей позиций (varint)
+// Секция doc блока зависит только от последнего doc предыдущего блока,
+// поэтому next_geq перескакивает блоки по таблице, не распаковывая их.
+//
+// Кодеки секции doc (выбираются для каждого списка, choose_codec):
+//   kCodecVByte - разности varint, первая - от последнего doc предыдущего блока;
+//   kCodecRaw - uint32 doc как есть;
+//   kCodecPacked - uint8 ширина w, затем разности по w бит;
+//   kCodecBitmap - битовая карта блока: бит doc - base, (последний doc
+//     блока - base + 1) бит, base = последний doc предыдущего блока + 1;
+//   kCodecEliasFano - Elias-Fano по частям, описан ниже.
+// Все, кроме Elias-Fano, распаковываются в массив doc блока при переходе
+// к нему.
+//
+// Elias-Fano: блок - отдельная часть со своим универсумом
+// [base, последний doc блока]. Значение v = doc - base
+// делится на L = floor(log2(u / n)) младших бит (n x L бит подряд) и
+// старшую часть v >> L, записанную в унарном виде: бит (v_i >> L) + i
+// старшего массива ((v_max >> L) + n бит). Обе части дополнены до байта.
+// Около 2 + log2(u / n) бит на doc; next_geq внутри блока находит начало
+// корзины target >> L выбором нуля (select0) в старших битах, а не
+// распаковкой блока.
+// tf, вклады и позиции раскодируются только по запросу, во всех кодеках.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static constexpr uint32_t kBlockSize = 128;
+static constexpr uint32_t kEndDoc = UINT32_MAX;
+
+enum PostingCodec : uint8_t { kCodecVByte = 0, kCodecEliasFano = 1, kCodecRaw = 2, kCodecPacked = 3, kCodecBitmap = 4 };
+static constexpr uint32_t kNumCodecs = 5;
+
+inline const char* codec_name(PostingCodec c) {
+    static constexpr const char* kNames[kNumCodecs] = {"vbyte", "ef", "raw", "packed", "bitmap"};
+    return c < kNumCodecs ? kNames[c] : "?";
+}
+
+inline void put_varint32(std::string& out, uint32_t v) {
+    while (v >= 0x80) {
+        out.push_back((char)((v & 0x7F) | 0x80));
+        v >>= 7;
+    }
+    out.push_back((char)v);
+}
+
+inline const uint8_t* get_varint32(const uint8_t* p, uint32_t& v) {
+    uint32_t x = *p++;
+    if (x < 0x80) { v = x; return p; }
+    x &= 0x7F;
+    for (int shift = 7; shift < 35; shift += 7) {
+        const uint32_t b = *p++;
+        x |= (b & 0x7F) << shift;
+        if (b < 0x80) break;
+    }
+    v = x;
+    return p;
+}
+
+// Пропускает n varint-чисел, не раскодируя их: считаются байты без старшего
+// бита, по 8 байт за шаг. Читает до 7 байт за концом пропускаемых данных -
+// это безопасно, потому что за списками в файле индекса всегда идет словарь.
+inline const uint8_t* skip_varints(const uint8_t* p, uint64_t n) {
+    while (n >= 8) {
+        uint64_t w;
+        std::memcpy(&w, p, sizeof(w));
+        const uint64_t ends = (uint64_t)__builtin_popcountll(~w & 0x8080808080808080ULL);
+        if (ends >= n) break;
+        p += 8;
+        n -= ends;
+    }
+    for (; n > 0; p++) n -= (*p & 0x80) == 0;
+    return p;
+}
+
+inline uint32_t load_u32(const char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint32_t load_u16(const uint8_t* p) {
+    uint16_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t load_u64(const uint8_t* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint32_t posting_blocks(uint32_t df) {
+    return (df + kBlockSize - 1) / kBlockSize;
+}
+
+// Записывает width младших бит v начиная с бита bit (буфер обнулен заранее).
+inline void put_bits(uint8_t* p, uint64_t bit, uint64_t v, uint32_t width) {
+    for (uint32_t j = 0; j < width; j++, bit++) {
+        if ((v >> j) & 1) p[bit >> 3] |= (uint8_t)(1u << (bit & 7));
+    }
+}
+
+// width <= 32; читает до 8 байт с бита bit.
+inline uint32_t get_bits(const uint8_t* p, uint64_t bit, uint32_t width) {
+    return (uint32_t)((load_u64(p + (bit >> 3)) >> (bit & 7)) & ((1ULL << width) - 1));
+}
+
+inline uint32_t bit_width(uint32_t v) {
+    return v ? 32 - (uint32_t)__builtin_clz(v) : 0;
+}
+
+// Число младших бит Elias-Fano для n значений из [0, u).
+inline uint32_t ef_low_bits(uint64_t u, uint32_t n) {
+    return n && u > n ? 63 - (uint32_t)__builtin_clzll(u / n) : 0;
+}
+
+// Дописывает в out docs[from, to) - base в формате Elias-Fano (см. выше).
+inline void encode_ef_part(const std::vector<uint32_t>& docs, uint32_t from, uint32_t to, uint32_t base, std::string& out) {
+    const uint32_t n = to - from;
+    const uint32_t L = ef_low_bits((uint64_t)docs[to - 1] - base + 1, n);
+    const size_t low_at = out.size();
+    const uint64_t high_bits = (((uint64_t)docs[to - 1] - base) >> L) + n;
+    out.resize(low_at + ((uint64_t)n * L + 7) / 8 + (high_bits + 7) / 8, '\0');
+    uint8_t* low = reinterpret_cast<uint8_t*>(&out[low_at]);
+    uint8_t* high = low + ((uint64_t)n * L + 7) / 8;
+    for (uint32_t i = 0; i < n; i++) {
+        const uint64_t v = docs[from + i] - base;
+        put_bits(low, (uint64_t)i * L, v, L);
+        const uint64_t h = (v >> L) + i;
+        high[h >> 3] |= (uint8_t)(1u << (h & 7));
+    }
+}
+
+// Секция doc блока docs[from, to); prev - последний doc предыдущего блока,
+// first - блок первый в списке.
+inline void encode_block_docs(const std::vector<uint32_t>& docs, uint32_t from, uint32_t to, uint32_t prev, bool first,
+                              PostingCodec codec, std::string& out) {
+    const uint32_t base = first ? 0 : prev + 1;
+    switch (codec) {
+    case kCodecEliasFano:
+        encode_ef_part(docs, from, to, base, out);
+        break;
+    case kCodecRaw:
+        out.append(reinterpret_cast<const char*>(docs.data() + from), (size_t)(to - from) * sizeof(uint32_t));
+        break;
+    case kCodecPacked: {
+        uint32_t width = 0;
+        for (uint32_t i = from, p = prev; i < to; p = docs[i++]) width = std::max(width, bit_width(docs[i] - p));
+        const size_t at = out.size();
+        out.resize(at + 1 + ((uint64_t)(to - from) * width + 7) / 8, '\0');
+        out[at] = (char)width;
+        uint8_t* bits = reinterpret_cast<uint8_t*>(&out[at + 1]);
+        for (uint32_t i = from, p = prev; i < to; p = docs[i++]) put_bits(bits, (uint64_t)(i - from) * width, docs[i] - p, width);
+        break;
+    }
+    case kCodecBitmap: {
+        const size_t at = out.size();
+        out.resize(at + ((uint64_t)docs[to - 1] - base + 8) / 8, '\0');
+        for (uint32_t i = from; i < to; i++) {
+            const uint32_t v = docs[i] - base;
+            out[at + (v >> 3)] |= (char)(1u << (v & 7));
+        }
+        break;
+    }
+    default:
+        for (uint32_t i = from; i < to; i++) {
+            put_varint32(out, docs[i] - prev);
+            prev = docs[i];
+        }
+    }
+}
+
+// Размеры секции doc блока docs[from, to) во всех кодеках, байт - без
+// кодирования: по диапазону значений блока и разностям, за один проход.
+// Совпадают с размерами, которые пишет encode_block_docs.
+inline void block_docs_bytes(const std::vector<uint32_t>& docs, uint32_t from, uint32_t to, uint32_t prev, bool first,
+                             uint64_t (&bytes)[kNumCodecs]) {
+    const uint32_t n = to - from;
+    const uint32_t base = first ? 0 : prev + 1;
+    const uint64_t range = (uint64_t)docs[to - 1] - base;
+    uint64_t vbyte = 0;
+    uint32_t width = 0;
+    for (uint32_t i = from, p = prev; i < to; p = docs[i++]) {
+        const uint32_t w = bit_width(docs[i] - p);
+        vbyte += w ? (w + 6) / 7 : 1;
+        width = std::max(width, w);
+    }
+    const uint32_t L = ef_low_bits(range + 1, n);
+    bytes[kCodecVByte] = vbyte;
+    bytes[kCodecEliasFano] = ((uint64_t)n * L + 7) / 8 + ((range >> L) + n + 7) / 8;
+    bytes[kCodecRaw] = (uint64_t)n * sizeof(uint32_t);
+    bytes[kCodecPacked] = 1 + ((uint64_t)n * width + 7) / 8;
+    bytes[kCodecBitmap] = (range + 8) / 8;
+}
+
+// Время декодирования одного постинга, нс: среднее next() и next_geq с
+// короткими шагами на синтетических списках плотности 0.01..0.9. Для
+// битовой карты - плотные списки; редкие ей не достаются из-за размера.
+static constexpr double kCodecDecodeNs[kNumCodecs] = {1.8, 5.2, 0.8, 2.0, 1.8};
+
+// Кодек с наименьшей стоимостью: размер секций doc в битах плюс lambda бит
+// за каждую ожидаемую наносекунду декодирования. Список терма, который есть
+// в доле df / num_docs документов, просматривается запросами примерно с той
+// же частотой, поэтому время декодирования его df постингов весится этой
+// долей: редким термам достается самый компактный кодек, частым - самый
+// быстрый из достаточно компактных.
+// Размеры считаются по блокам (block_docs_bytes), пробного кодирования нет:
+// битовая карта редкого списка заняла бы (последний doc) / 8 байт.
+inline PostingCodec choose_codec(const std::vector<uint32_t>& docs, uint32_t num_docs, double lambda) {
+    const uint32_t df = (uint32_t)docs.size();
+    const double share = num_docs ? (double)df / num_docs : 1.0;
+    uint64_t total[kNumCodecs] = {};
+    uint32_t prev = 0;
+    for (uint32_t from = 0; from < df; from += kBlockSize) {
+        const uint32_t to = std::min(df, from + kBlockSize);
+        uint64_t bytes[kNumCodecs];
+        block_docs_bytes(docs, from, to, prev, from == 0, bytes);
+        for (uint32_t c = 0; c < kNumCodecs; c++) total[c] += bytes[c];
+        prev = docs[to - 1];
+    }
+    PostingCodec best = kCodecVByte;
+    double best_cost = 0.0;
+    for (uint32_t c = 0; c < kNumCodecs; c++) {
+        const double cost = 8.0 * total[c] + lambda * share * df * kCodecDecodeNs[c];
+        if (c == 0 || cost < best_cost) {
+            best = (PostingCodec)c;
+            best_cost = cost;
+        }
+    }
+    return best;
+}
+
+// Кодирует отсортированный по doc список (docs, tfs) и дописывает его в out.
+// positions - позиции всех постингов подряд (по tf на постинг, по возрастанию)
+// или пустой вектор, если позиции не хранятся. impacts - вклады постингов,
+// если impact_bytes != 0.
+inline void encode_postings(const std::vector<uint32_t>& docs, const std::vector<uint32_t>& tfs,
+                            const std::vector<uint32_t>& positions, std::string& out,
+                            const std::vector<uint32_t>& impacts = {}, uint32_t impact_bytes = 0,
+                            PostingCodec codec = kCodecVByte) {
+    const uint32_t df = (uint32_t)docs.size();
+    const uint32_t nb = posting_blocks(df);
+    const size_t skip_at = out.size();
+    out.resize(out.size() + (size_t)nb * 2 * sizeof(uint32_t));
+    const size_t data_at = out.size();
+
+    uint32_t prev = 0;
+    size_t pos_at = 0;
+    for (uint32_t b = 0; b < nb; b++) {
+        const uint32_t from = b * kBlockSize;
+        const uint32_t to = std::min(df, from + kBlockSize);
+        encode_block_docs(docs, from, to, prev, b == 0, codec, out);
+        prev = docs[to - 1];
+        for (uint32_t i = from; i < to; i++) {
+            put_varint32(out, tfs[i]);
+        }
+        for (uint32_t i = from; impact_bytes && i < to; i++) {
+            const uint16_t v = (uint16_t)impacts[i];
+            out.append(reinterpret_cast<const char*>(&v), impact_bytes);
+        }
+        if (!positions.empty()) {
+            for (uint32_t i = from; i < to; i++) {
+                uint32_t prev_pos = 0;
+                for (uint32_t j = 0; j < tfs[i]; j++, pos_at++) {
+                    put_varint32(out, positions[pos_at] - prev_pos);
+                    prev_pos = positions[pos_at];
+                }
+            }
+        }
+        const uint32_t entry[2] = {docs[to - 1], (uint32_t)(out.size() - data_at)};
+        std::memcpy(&out[skip_at + (size_t)b * sizeof(entry)], entry, sizeof(entry));
+    }
+}
+
+class PostingIterator {
+public:
+    PostingIterator() = default;
+
+    PostingIterator(const char* list, uint32_t df, bool has_positions = false, uint32_t impact_bytes = 0,
+                    PostingCodec codec = kCodecVByte) {
+        reset(list, df, has_positions, impact_bytes, codec);
+    }
+
+    void reset(const char* list, uint32_t df, bool has_positions = false, uint32_t impact_bytes = 0,
+               PostingCodec codec = kCodecVByte) {
+        df_ = df;
+        has_positions_ = has_positions;
+        impact_bytes_ = impact_bytes;
+        codec_ = codec;
+        nblocks_ = posting_blocks(df);
+        skip_ = list;
+        data_ = reinterpret_cast<const uint8_t*>(list + (size_t)nblocks_ * 2 * sizeof(uint32_t));
+        block_ = kNoBlock;
+        if (df_ == 0) {
+            cur_ = kEndDoc;
+            return;
+        }
+        load_block(0);
+    }
+
+    uint32_t df() const { return df_; }
+    PostingCodec codec() const { return codec_; }
+    uint32_t doc() const { return cur_; }
+    uint32_t tf() const {
+        if (!tfs_ready_) load_tfs();
+        return tfs_[i_];
+    }
+    // Квантованный вклад текущего постинга (только для индекса с вкладами).
+    uint32_t impact() const {
+        if (!tfs_ready_) load_tfs();
+        return impact_bytes_ == 1 ? impacts_[i_] : load_u16(impacts_ + 2 * (size_t)i_);
+    }
+    bool at_end() const { return cur_ == kEndDoc; }
+
+    void next() {
+        if (cur_ == kEndDoc) return;
+        if (++i_ < n_) {
+            cur_ = codec_ == kCodecEliasFano ? ef_next() : docs_[i_];
+        } else if (block_ + 1 < nblocks_) {
+            load_block(block_ + 1);
+        } else {
+            cur_ = kEndDoc;
+        }
+    }
+
+    // Переходит к первому doc >= target.
+    void next_geq(uint32_t target) {
+        if (cur_ >= target) return;
+        uint32_t b = block_;
+        while (b < nblocks_ && block_last(b) < target) b++;
+        if (b == nblocks_) {
+            cur_ = kEndDoc;
+            return;
+        }
+        if (b != block_) load_block(b);
+        if (codec_ == kCodecEliasFano) {
+            ef_next_geq(target);
+            return;
+        }
+        while (docs_[i_] < target) i_++;
+        cur_ = docs_[i_];
+    }
+
+    bool has_positions() const { return has_positions_; }
+
+    // Позиции текущего постинга. Раскодируются лениво: курсор по секции
+    // позиций блока сдвигается только вперед, назад - с начала блока.
+    void positions(std::vector<uint32_t>& out) {
+        out.clear();
+        if (!has_positions_ || cur_ == kEndDoc) return;
+        if (!tfs_ready_) load_tfs();
+        if (pos_i_ > i_) {
+            pos_p_ = pos_start_;
+            pos_i_ = 0;
+        }
+        uint64_t skip = 0;
+        for (; pos_i_ < i_; pos_i_++) skip += tfs_[pos_i_];
+        pos_p_ = skip_varints(pos_p_, skip);
+        uint32_t pos = 0;
+        out.reserve(tfs_[i_]);
+        for (uint32_t j = 0; j < tfs_[i_]; j++) {
+            uint32_t gap;
+            pos_p_ = get_varint32(pos_p_, gap);
+            pos += gap;
+            out.push_back(pos);
+        }
+        pos_i_++;
+    }
+
+    // Верхняя граница doc в текущем блоке (для пропуска блоков в ранжировании).
+    uint32_t block_last_doc() const { return cur_ == kEndDoc ? kEndDoc : block_last(block_); }
+
+private:
+    static constexpr uint32_t kNoBlock = UINT32_MAX;
+
+    uint32_t block_last(uint32_t b) const { return load_u32(skip_ + (size_t)b * 8); }
+    uint32_t block_end(uint32_t b) const { return load_u32(skip_ + (size_t)b * 8 + 4); }
+
+    void load_block(uint32_t b) {
+        const uint8_t* p = data_ + (b == 0 ? 0 : block_end(b - 1));
+        n_ = (b + 1 < nblocks_) ? kBlockSize : df_ - b * kBlockSize;
+        block_ = b;
+        i_ = 0;
+        tfs_ready_ = false;
+        const uint32_t prev = (b == 0) ? 0 : block_last(b - 1);
+        const uint32_t base = (b == 0) ? 0 : prev + 1;
+        switch (codec_) {
+        case kCodecEliasFano:
+            ef_base_ = base;
+            ef_l_ = ef_low_bits((uint64_t)block_last(b) - ef_base_ + 1, n_);
+            ef_low_ = p;
+            ef_high_ = p + ((uint64_t)n_ * ef_l_ + 7) / 8;
+            tf_start_ = ef_high_ + ((((uint64_t)block_last(b) - ef_base_) >> ef_l_) + n_ + 7) / 8;
+            hpos_ = ef_next_one(0);
+            cur_ = ef_value();
+            return;
+        case kCodecRaw:
+            std::memcpy(docs_, p, (size_t)n_ * sizeof(uint32_t));
+            tf_start_ = p + (size_t)n_ * sizeof(uint32_t);
+            break;
+        case kCodecPacked: {
+            const uint32_t width = *p++;
+            uint32_t doc = prev;
+            for (uint32_t i = 0; i < n_; i++) {
+                doc += width ? get_bits(p, (uint64_t)i * width, width) : 0;
+                docs_[i] = doc;
+            }
+            tf_start_ = p + ((uint64_t)n_ * width + 7) / 8;
+            break;
+        }
+        case kCodecBitmap: {
+            // Последний бит карты - всегда последний doc блока.
+            for (uint32_t i = 0, w = 0; i < n_; w++) {
+                for (uint64_t bits = load_u64(p + (size_t)w * 8); bits && i < n_; bits &= bits - 1) {
+                    docs_[i++] = base + w * 64 + (uint32_t)__builtin_ctzll(bits);
+                }
+            }
+            tf_start_ = p + ((uint64_t)block_last(b) - base + 8) / 8;
+            break;
+        }
+        default: {
+            uint32_t doc = prev;
+            for (uint32_t i = 0; i < n_; i++) {
+                uint32_t gap;
+                p = get_varint32(p, gap);
+                doc += gap;
+                docs_[i] = doc;
+            }
+            tf_start_ = p;
+        }
+        }
+        cur_ = docs_[0];
+    }
+
+    void load_tfs() const {
+        const uint8_t* p = tf_start_;
+        for (uint32_t i = 0; i < n_; i++) {
+            p = get_varint32(p, tfs_[i]);
+        }
+        impacts_ = p;
+        p += (size_t)n_ * impact_bytes_;
+        pos_start_ = pos_p_ = p;
+        pos_i_ = 0;
+        tfs_ready_ = true;
+    }
+
+    // Elias-Fano: старшие биты читаются по 8 байт; чтение за концом части
+    // безопасно по той же причине, что в skip_varints.
+    uint64_t ef_word(uint64_t w) const { return load_u64(ef_high_ + w * 8); }
+
+    // Позиция первой единицы старшего массива, не меньшая pos.
+    uint64_t ef_next_one(uint64_t pos) const {
+        uint64_t w = pos >> 6;
+        uint64_t bits = ef_word(w) & (~0ULL << (pos & 63));
+        while (!bits) bits = ef_word(++w);
+        return w * 64 + (uint64_t)__builtin_ctzll(bits);
+    }
+
+    uint32_t ef_value() const {
+        uint64_t low = 0;
+        if (ef_l_) {
+            const uint64_t bit = (uint64_t)i_ * ef_l_;
+            low = (load_u64(ef_low_ + (bit >> 3)) >> (bit & 7)) & ((1ULL << ef_l_) - 1);
+        }
+        return ef_base_ + (uint32_t)(((hpos_ - i_) << ef_l_) | low);
+    }
+
+    uint32_t ef_next() {
+        hpos_ = ef_next_one(hpos_ + 1);
+        return ef_value();
+    }
+
+    // target не больше последнего doc блока.
+    void ef_next_geq(uint32_t target) {
+        if (cur_ >= target) return;
+        const uint64_t bucket = (uint64_t)(target - ef_base_) >> ef_l_;
+        if (bucket > hpos_ - i_ + 1) {
+            // Позиция после bucket-го нуля: нулей до hpos_ ровно hpos_ - i_.
+            uint64_t need = bucket - (hpos_ - i_);
+            uint64_t w = (hpos_ + 1) >> 6;
+            uint64_t zeros = ~ef_word(w) & (~0ULL << ((hpos_ + 1) & 63));
+            for (uint64_t c; (c = (uint64_t)__builtin_popcountll(zeros)) < need; zeros = ~ef_word(++w)) need -= c;
+            while (--need) zeros &= zeros - 1;
+            const uint64_t after = w * 64 + (uint64_t)__builtin_ctzll(zeros) + 1;
+            i_ = (uint32_t)(after - bucket);
+            hpos_ = ef_next_one(after);
+            cur_ = ef_value();
+        }
+        while (cur_ < target) {
+            i_++;
+            cur_ = ef_next();
+        }
+    }
+
+    const char* skip_ = nullptr;
+    const uint8_t* data_ = nullptr;
+    const uint8_t* tf_start_ = nullptr;
+    // tf, вклады и начало позиций блока раскодируются лениво (load_tfs).
+    mutable const uint8_t* impacts_ = nullptr;
+    mutable const uint8_t* pos_start_ = nullptr;
+    mutable const uint8_t* pos_p_ = nullptr;
+    mutable uint32_t pos_i_ = 0;
+    mutable bool tfs_ready_ = false;
+    bool has_positions_ = false;
+    PostingCodec codec_ = kCodecVByte;
+    const uint8_t* ef_low_ = nullptr;
+    const uint8_t* ef_high_ = nullptr;
+    uint64_t hpos_ = 0;      // позиция единицы текущего постинга в старших битах
+    uint32_t ef_base_ = 0;
+    uint32_t ef_l_ = 0;
+    uint32_t impact_bytes_ = 0;
+    uint32_t df_ = 0;
+    uint32_t nblocks_ = 0;
+    uint32_t block_ = kNoBlock;
+    uint32_t i_ = 0;
+    uint32_t n_ = 0;
+    uint32_t cur_ = kEndDoc;
+    uint32_t docs_[kBlockSize];
+    mutable uint32_t tfs_[kBlockSize];
+};
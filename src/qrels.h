@@ -0,0 +1,119 @@
+#pragma once
+
+// Оценки релевантности (qrels) для офлайн-проверки качества поиска.
+// Формат - строки TREC "topic 0 doc_id rel" или "topic doc_id rel",
+// разделители - пробелы или табуляции. rel > 0 - документ релевантен.
+// Выдача (run) в формате TREC: "topic Q0 doc_id rank score tag".
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using Qrels = std::unordered_map<std::string, std::unordered_map<std::string, int>>;
+
+inline bool load_qrels(const std::string& path, Qrels& qrels) {
+    std::ifstream in(path);
+    if (!in) return false;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream ss(line);
+        std::vector<std::string> f;
+        for (std::string x; ss >> x;) f.push_back(x);
+        if (f.size() != 3 && f.size() != 4) continue;
+        const std::string& doc = f[f.size() - 2];
+        try {
+            qrels[f[0]][doc] = std::stoi(f.back());
+        } catch (...) {
+            continue;
+        }
+    }
+    return true;
+}
+
+inline size_t count_relevant(const std::unordered_map<std::string, int>& judged) {
+    size_t n = 0;
+    for (const auto& [doc, rel] : judged) n += rel > 0;
+    return n;
+}
+
+inline bool is_relevant(const std::unordered_map<std::string, int>& judged, const std::string& doc) {
+    auto it = judged.find(doc);
+    return it != judged.end() && it->second > 0;
+}
+
+// Доля релевантных документов темы, найденных в первых k результатах.
+inline double recall_at(const std::unordered_map<std::string, int>& judged, const std::vector<std::string>& ranked, size_t k) {
+    const size_t total = count_relevant(judged);
+    if (total == 0) return 0.0;
+    size_t found = 0;
+    for (size_t i = 0; i < ranked.size() && i < k; i++) found += is_relevant(judged, ranked[i]);
+    return (double)found / (double)total;
+}
+
+inline double precision_at(const std::unordered_map<std::string, int>& judged, const std::vector<std::string>& ranked, size_t k) {
+    if (k == 0) return 0.0;
+    size_t found = 0;
+    for (size_t i = 0; i < ranked.size() && i < k; i++) found += is_relevant(judged, ranked[i]);
+    return (double)found / (double)k;
+}
+
+// Средняя точность по всей выдаче (для MAP).
+inline double average_precision(const std::unordered_map<std::string, int>& judged, const std::vector<std::string>& ranked) {
+    const size_t total = count_relevant(judged);
+    if (total == 0) return 0.0;
+    size_t found = 0;
+    double sum = 0.0;
+    for (size_t i = 0; i < ranked.size(); i++) {
+        if (!is_relevant(judged, ranked[i])) continue;
+        found++;
+        sum += (double)found / (double)(i + 1);
+    }
+    return sum / (double)total;
+}
+
+// nDCG@k с градуированной релевантностью: gain = 2^rel - 1.
+inline double ndcg_at(const std::unordered_map<std::string, int>& judged, const std::vector<std::string>& ranked, size_t k) {
+    auto gain = [](int rel) { return rel > 0 ? std::pow(2.0, rel) - 1.0 : 0.0; };
+    double dcg = 0.0;
+    for (size_t i = 0; i < ranked.size() && i < k; i++) {
+        auto it = judged.find(ranked[i]);
+        if (it != judged.end()) dcg += gain(it->second) / std::log2((double)i + 2.0);
+    }
+    std::vector<int> ideal;
+    for (const auto& [doc, rel] : judged) {
+        if (rel > 0) ideal.push_back(rel);
+    }
+    std::sort(ideal.rbegin(), ideal.rend());
+    double idcg = 0.0;
+    for (size_t i = 0; i < ideal.size() && i < k; i++) idcg += gain(ideal[i]) / std::log2((double)i + 2.0);
+    return idcg > 0.0 ? dcg / idcg : 0.0;
+}
+
+// Выдача по темам в порядке рангов.
+inline bool load_run(const std::string& path, std::map<std::string, std::vector<std::string>>& run) {
+    std::ifstream in(path);
+    if (!in) return false;
+    std::map<std::string, std::vector<std::pair<long, std::string>>> ranked;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream ss(line);
+        std::string topic, q0, doc;
+        long rank = 0;
+        if (!(ss >> topic >> q0 >> doc >> rank)) continue;
+        ranked[topic].emplace_back(rank, doc);
+    }
+    for (auto& [topic, docs] : ranked) {
+        std::stable_sort(docs.begin(), docs.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+        auto& out = run[topic];
+        for (auto& d : docs) out.push_back(std::move(d.second));
+    }
+    return true;
+}
@@ -0,0 +1,582 @@
+#pragma once
+
+// Разбор булевых запросов и их вычисление по индексу.
+// Грамматика:
+//   or   := and { ("||" | "|") and }
+//   and  := unary { ["&&" | "&"] unary }     пробел между операндами - тоже И
+//   unary:= "!" unary | "(" or ")" | слово | "фраза в кавычках" | range:[a TO b]
+// range:[a TO b] - документы, где встречается число из [a, b] (границы
+// включаются, "*" - без границы); вычисляется по числовому индексу.
+// Слова нормализуются так же, как корпус (normalize_query_text), поэтому
+// слово может дать ноль термов (число) или несколько (через дефис).
+// Словосочетания из словаря (phrase_dict.h) внутри фразы ищутся одним термом,
+// частые пары соседних слов - по индексу биграмм (biword.h).
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "bitmap.h"
+#include "biword.h"
+#include "index_format.h"
+#include "text_ru.h"
+
+struct QueryNode {
+    enum Kind { Term, Phrase, And, Or, Not, Range };
+    Kind kind;
+    std::vector<std::string> terms;                  // Term: один терм, Phrase: термы фразы (пусто у вариантов расширения)
+    std::vector<uint32_t> offsets;                   // Phrase: позиция терма относительно первого
+    std::vector<uint32_t> ids;                       // Term, Phrase: id термов, если узел уже разрешен по индексу
+    uint64_t lo = 0;                                 // Range: границы включительно
+    uint64_t hi = UINT64_MAX;
+    std::vector<std::unique_ptr<QueryNode>> children;
+
+    explicit QueryNode(Kind k) : kind(k) {}
+};
+using QueryPtr = std::unique_ptr<QueryNode>;
+
+class QueryParser {
+public:
+    explicit QueryParser(std::string_view query) : q_(query) {}
+
+    // nullptr, если в запросе не осталось ни одного терма.
+    QueryPtr parse() {
+        pos_ = 0;
+        QueryPtr root = parse_or();
+        return root;
+    }
+
+private:
+    enum Tok { End, LParen, RParen, AndOp, OrOp, NotOp, Word, Quoted, RangeTok };
+
+    Tok peek() {
+        while (pos_ < q_.size() && (q_[pos_] == ' ' || q_[pos_] == '\t')) pos_++;
+        if (pos_ >= q_.size()) return End;
+        if (q_.compare(pos_, kRangePrefix.size(), kRangePrefix) == 0) return RangeTok;
+        switch (q_[pos_]) {
+            case '(': return LParen;
+            case ')': return RParen;
+            case '&': return AndOp;
+            case '|': return OrOp;
+            case '!': return NotOp;
+            case '"': return Quoted;
+            default: return Word;
+        }
+    }
+
+    // Операторы можно писать одинарными или двойными: & и &&, | и ||.
+    void consume_op() {
+        const char c = q_[pos_++];
+        if (pos_ < q_.size() && q_[pos_] == c && c != '!') pos_++;
+    }
+
+    std::string_view take_word() {
+        const size_t from = pos_;
+        while (pos_ < q_.size() && std::string_view(" \t()&|!\"").find(q_[pos_]) == std::string_view::npos) pos_++;
+        return q_.substr(from, pos_ - from);
+    }
+
+    std::string_view take_quoted() {
+        const size_t from = ++pos_;
+        while (pos_ < q_.size() && q_[pos_] != '"') pos_++;
+        std::string_view text = q_.substr(from, pos_ - from);
+        if (pos_ < q_.size()) pos_++;
+        return text;
+    }
+
+    static bool parse_bound(std::string_view s, uint64_t open_value, uint64_t& out) {
+        if (s == "*") {
+            out = open_value;
+            return true;
+        }
+        if (s.empty() || s.size() > 18) return false;
+        out = 0;
+        for (char c : s) {
+            if (c < '0' || c > '9') return false;
+            out = out * 10 + (uint64_t)(c - '0');
+        }
+        return true;
+    }
+
+    // "range:[a TO b]"; nullptr, если границы не разобраны.
+    QueryPtr take_range() {
+        pos_ += kRangePrefix.size();
+        const size_t close = q_.find(']', pos_);
+        std::string_view body = q_.substr(pos_, close == std::string_view::npos ? std::string_view::npos : close - pos_);
+        pos_ = close == std::string_view::npos ? q_.size() : close + 1;
+
+        std::vector<std::string_view> parts;
+        for (size_t i = 0; i < body.size();) {
+            while (i < body.size() && body[i] == ' ') i++;
+            const size_t from = i;
+            while (i < body.size() && body[i] != ' ') i++;
+            if (i > from) parts.push_back(body.substr(from, i - from));
+        }
+        QueryPtr node = std::make_unique<QueryNode>(QueryNode::Range);
+        if (parts.size() != 3 || (parts[1] != "TO" && parts[1] != "to") ||
+            !parse_bound(parts[0], 0, node->lo) || !parse_bound(parts[2], UINT64_MAX, node->hi)) {
+            return nullptr;
+        }
+        return node;
+    }
+
+    static QueryPtr make_terms(std::string_view text, bool quoted) {
+        std::vector<uint32_t> positions;
+        std::vector<std::string> terms = normalize_query_text(text, &positions);
+        if (terms.empty()) return nullptr;
+        QueryPtr node = std::make_unique<QueryNode>(terms.size() == 1 ? QueryNode::Term : QueryNode::Phrase);
+        if (!quoted && terms.size() > 1) node->kind = QueryNode::And;
+        if (node->kind == QueryNode::And) {
+            for (auto& t : terms) {
+                node->children.push_back(std::make_unique<QueryNode>(QueryNode::Term));
+                node->children.back()->terms.push_back(std::move(t));
+            }
+        } else {
+            node->terms = std::move(terms);
+            for (uint32_t p : positions) node->offsets.push_back(p - positions[0]);
+        }
+        return node;
+    }
+
+    static QueryPtr combine(QueryNode::Kind kind, std::vector<QueryPtr>& parts) {
+        if (parts.empty()) return nullptr;
+        if (parts.size() == 1) return std::move(parts[0]);
+        QueryPtr node = std::make_unique<QueryNode>(kind);
+        for (auto& p : parts) {
+            // (a & b) & c -> &(a, b, c)
+            if (p->kind == kind) {
+                for (auto& c : p->children) node->children.push_back(std::move(c));
+            } else {
+                node->children.push_back(std::move(p));
+            }
+        }
+        return node;
+    }
+
+    QueryPtr parse_or() {
+        std::vector<QueryPtr> parts;
+        for (;;) {
+            if (QueryPtr p = parse_and()) parts.push_back(std::move(p));
+            if (peek() != OrOp) break;
+            consume_op();
+        }
+        return combine(QueryNode::Or, parts);
+    }
+
+    QueryPtr parse_and() {
+        std::vector<QueryPtr> parts;
+        for (;;) {
+            Tok t = peek();
+            if (t == AndOp) {
+                consume_op();
+                continue;
+            }
+            if (t == End || t == RParen || t == OrOp) break;
+            if (QueryPtr p = parse_unary()) parts.push_back(std::move(p));
+        }
+        return combine(QueryNode::And, parts);
+    }
+
+    QueryPtr parse_unary() {
+        switch (peek()) {
+            case NotOp: {
+                consume_op();
+                QueryPtr inner = parse_unary();
+                if (!inner) return nullptr;
+                QueryPtr node = std::make_unique<QueryNode>(QueryNode::Not);
+                node->children.push_back(std::move(inner));
+                return node;
+            }
+            case LParen: {
+                pos_++;
+                QueryPtr inner = parse_or();
+                if (peek() == RParen) pos_++;
+                return inner;
+            }
+            case Quoted:
+                return make_terms(take_quoted(), true);
+            case Word:
+                return make_terms(take_word(), false);
+            case RangeTok:
+                return take_range();
+            default:
+                pos_++;
+                return nullptr;
+        }
+    }
+
+    static constexpr std::string_view kRangePrefix = "range:[";
+
+    std::string_view q_;
+    size_t pos_ = 0;
+};
+
+// id терма i узла: разрешенный при расширении запроса или из словаря.
+inline int64_t node_term_id(const QueryNode& node, size_t i, const IndexReader& idx) {
+    return i < node.ids.size() ? (int64_t)node.ids[i] : idx.lookup(node.terms[i]);
+}
+
+// Узлы вариантов из expand_query хранят только id; строка терма берется
+// из словаря там, где она нужна.
+inline size_t node_term_count(const QueryNode& node) {
+    return std::max(node.terms.size(), node.ids.size());
+}
+
+inline std::string_view node_term_text(const QueryNode& node, size_t i, const IndexReader& idx) {
+    return i < node.terms.size() ? std::string_view(node.terms[i]) : idx.term_text(node.ids[i]);
+}
+
+// Расширение запроса по индексу. Терм разрешается в id вместе с формами в
+// другой письменности (IndexReader::lookup_variants), к ним добавляются
+// синонимы из таблицы индекса (synonyms.h) - уже готовые id, многословный
+// синоним - узел фразы. Если вариантов больше одного, терм заменяется ИЛИ
+// по ним. Внутри ИЛИ варианты встраиваются прямо в родителя, чтобы "a | b"
+// оставался чистой дизъюнкцией для WAND.
+inline void expand_query(QueryPtr& node, const IndexReader& idx) {
+    std::vector<uint32_t> ids;
+    std::vector<SynonymAlt> alts, found;
+    auto variants = [&](QueryNode& term) -> QueryPtr {
+        idx.lookup_variants(term.terms[0], ids);
+        alts.clear();
+        for (uint32_t id : ids) {
+            idx.synonyms().lookup(id, found);
+            for (auto& a : found) {
+                if (a.ids.size() == 1 && std::binary_search(ids.begin(), ids.end(), a.ids[0])) continue;
+                alts.push_back(std::move(a));
+            }
+        }
+        if (ids.size() + alts.size() < 2) {
+            if (ids.size() == 1) term.ids = ids;
+            return nullptr;
+        }
+        QueryPtr alt = std::make_unique<QueryNode>(QueryNode::Or);
+        for (uint32_t id : ids) {
+            alt->children.push_back(std::make_unique<QueryNode>(QueryNode::Term));
+            alt->children.back()->ids.push_back(id);
+        }
+        for (auto& a : alts) {
+            QueryPtr n = std::make_unique<QueryNode>(a.ids.size() == 1 ? QueryNode::Term : QueryNode::Phrase);
+            n->ids = std::move(a.ids);
+            if (n->kind == QueryNode::Phrase) n->offsets = std::move(a.offsets);
+            alt->children.push_back(std::move(n));
+        }
+        return alt;
+    };
+
+    if (node->kind == QueryNode::Term) {
+        if (QueryPtr alt = variants(*node)) node = std::move(alt);
+        return;
+    }
+    std::vector<QueryPtr> children;
+    for (auto& c : node->children) {
+        if (c->kind != QueryNode::Term) {
+            expand_query(c, idx);
+        } else if (QueryPtr alt = variants(*c)) {
+            if (node->kind == QueryNode::Or) {
+                for (auto& v : alt->children) children.push_back(std::move(v));
+                continue;
+            }
+            c = std::move(alt);
+        }
+        children.push_back(std::move(c));
+    }
+    node->children = std::move(children);
+}
+
+// id термов запроса вне отрицаний - по ним считается релевантность;
+// термы, которых нет в словаре, пропускаются.
+inline void collect_positive_ids(const QueryNode& node, const IndexReader& idx, std::vector<uint32_t>& out) {
+    if (node.kind == QueryNode::Not) return;
+    for (size_t i = 0; i < node_term_count(node); i++) {
+        const int64_t id = node_term_id(node, i, idx);
+        if (id >= 0) out.push_back((uint32_t)id);
+    }
+    for (const auto& c : node.children) collect_positive_ids(*c, idx, out);
+}
+
+// Строки тех же термов - для поиска в других словарях (индекс заголовков).
+inline void collect_positive_terms(const QueryNode& node, const IndexReader& idx, std::vector<std::string>& out) {
+    if (node.kind == QueryNode::Not) return;
+    for (size_t i = 0; i < node_term_count(node); i++) out.emplace_back(node_term_text(node, i, idx));
+    for (const auto& c : node.children) collect_positive_terms(*c, idx, out);
+}
+
+// Запрос вида "a | b | c" без других операторов: его можно ранжировать WAND.
+inline bool is_pure_disjunction(const QueryNode& node) {
+    if (node.kind == QueryNode::Term) return true;
+    if (node.kind != QueryNode::Or) return false;
+    for (const auto& c : node.children) {
+        if (c->kind != QueryNode::Term) return false;
+    }
+    return true;
+}
+
+inline std::vector<uint32_t> decode_all(PostingIterator it) {
+    std::vector<uint32_t> docs;
+    docs.reserve(it.df());
+    for (; !it.at_end(); it.next()) docs.push_back(it.doc());
+    return docs;
+}
+
+inline std::vector<uint32_t> evaluate_query(const QueryNode& node, const IndexReader& idx);
+
+// Фраза: документы со всеми термами, затем проверка позиций. На одной
+// позиции может стоять несколько термов (составное слово и его части),
+// поэтому проверяется наличие каждого терма на своем смещении, а не
+// соседство токенов. Без позиций в индексе фраза вырождается в И; терм
+// плотного яруса без позиций (kTermNoPositions), не покрытый биграммой,
+// проверяется только на наличие в документе.
+inline std::vector<uint32_t> evaluate_phrase(const QueryNode& node, const IndexReader& idx) {
+    struct PhraseTerm {
+        PostingIterator it;
+        uint32_t offset;
+        std::vector<uint32_t> positions;
+    };
+    const size_t n = node_term_count(node);
+    auto offset = [&](size_t i) { return i < node.offsets.size() ? node.offsets[i] : (uint32_t)i; };
+    std::vector<PhraseTerm> pt;
+    std::vector<bool> covered(n, false);
+
+    // Слова подряд, которые есть в индексе как терм словосочетания
+    // (phrase_dict.h), заменяются этим термом; самая длинная замена - первой.
+    for (size_t i = 0; i < n;) {
+        size_t end = i + 1;
+        for (size_t j = n; j >= i + 2; j--) {
+            if (offset(j - 1) - offset(i) != j - 1 - i) continue;
+            std::string joined(node_term_text(node, i, idx));
+            for (size_t t = i + 1; t < j; t++) {
+                joined += (char)kPhraseJoiner;
+                joined += node_term_text(node, t, idx);
+            }
+            const int64_t id = idx.lookup(joined);
+            if (id < 0) continue;
+            pt.push_back({idx.postings((uint32_t)id), offset(i), {}});
+            std::fill(covered.begin() + i, covered.begin() + j, true);
+            end = j;
+            break;
+        }
+        i = end;
+    }
+
+    // Соседние слова с парой в индексе биграмм (biword.h) берутся из него,
+    // в том числе перекрывающиеся пары длинной фразы. Если фраза покрыта
+    // одним списком, позиции не проверяются вовсе.
+    if (const IndexReader* bi = idx.biwords()) {
+        for (size_t i = 0; i + 1 < n; i++) {
+            if ((covered[i] && covered[i + 1]) || offset(i + 1) != offset(i) + 1) continue;
+            const int64_t id = bi->lookup(biword_term(node_term_text(node, i, idx), node_term_text(node, i + 1, idx)));
+            if (id < 0) continue;
+            pt.push_back({bi->postings((uint32_t)id), offset(i), {}});
+            covered[i] = covered[i + 1] = true;
+        }
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (covered[i]) continue;
+        const int64_t id = node_term_id(node, i, idx);
+        if (id < 0) return {};
+        pt.push_back({idx.postings((uint32_t)id), offset(i), {}});
+    }
+    if (pt.empty()) return {};
+    // Списки с позициями - первыми: первый из них задает начало фразы.
+    std::sort(pt.begin(), pt.end(), [](const PhraseTerm& a, const PhraseTerm& b) {
+        if (a.it.has_positions() != b.it.has_positions()) return a.it.has_positions();
+        return a.it.df() < b.it.df();
+    });
+    const size_t positional = (size_t)std::count_if(pt.begin(), pt.end(), [](const PhraseTerm& t) {
+        return t.it.has_positions();
+    });
+
+    auto phrase_at = [&]() {
+        for (size_t i = 0; i < positional; i++) pt[i].it.positions(pt[i].positions);
+        for (uint32_t p : pt[0].positions) {
+            if (p < pt[0].offset) continue;
+            const uint32_t start = p - pt[0].offset;
+            bool ok = true;
+            for (size_t i = 1; i < positional && ok; i++) {
+                ok = std::binary_search(pt[i].positions.begin(), pt[i].positions.end(), start + pt[i].offset);
+            }
+            if (ok) return true;
+        }
+        return false;
+    };
+
+    const bool check = positional > 1;
+    std::vector<uint32_t> result;
+    PostingIterator& lead = pt[0].it;
+    while (!lead.at_end()) {
+        const uint32_t d = lead.doc();
+        uint32_t next = d;
+        for (size_t i = 1; i < pt.size(); i++) {
+            pt[i].it.next_geq(d);
+            if (pt[i].it.doc() != d) {
+                next = pt[i].it.doc();
+                break;
+            }
+        }
+        if (next == kEndDoc) break;
+        if (next != d) {
+            lead.next_geq(next);
+            continue;
+        }
+        if (!check || phrase_at()) result.push_back(d);
+        lead.next();
+    }
+    return result;
+}
+
+inline DocBitmap evaluate_range(const QueryNode& node, const IndexReader& idx) {
+    DocBitmap bitmap(idx.num_docs());
+    idx.numeric().range(node.lo, node.hi, bitmap);
+    return bitmap;
+}
+
+// И: сначала пересекаются термы от самого редкого, остальные термы
+// проверяются через next_geq, не распаковывая пропущенные блоки.
+// Числовые диапазоны и термы плотного яруса (kTermDense) применяются как
+// битовые фильтры, отрицания вычитаются в конце.
+inline std::vector<uint32_t> evaluate_and(const QueryNode& node, const IndexReader& idx) {
+    std::vector<uint32_t> term_ids;
+    std::vector<const QueryNode*> complex;
+    std::vector<const QueryNode*> negated;
+    std::vector<DocBitmap> ranges;
+
+    auto add_term = [&](const QueryNode& t) {
+        const int64_t id = node_term_id(t, 0, idx);
+        if (id < 0) return false;
+        term_ids.push_back((uint32_t)id);
+        return true;
+    };
+
+    for (const auto& c : node.children) {
+        if (c->kind == QueryNode::Not) {
+            negated.push_back(c->children[0].get());
+        } else if (c->kind == QueryNode::Range) {
+            ranges.push_back(evaluate_range(*c, idx));
+        } else if (c->kind == QueryNode::Term) {
+            if (!add_term(*c)) return {};
+        } else {
+            complex.push_back(c.get());
+        }
+    }
+    std::sort(term_ids.begin(), term_ids.end(), [&](uint32_t a, uint32_t b) { return idx.term(a).df < idx.term(b).df; });
+    term_ids.erase(std::unique(term_ids.begin(), term_ids.end()), term_ids.end());
+
+    // Термы плотного яруса - самые частые, поэтому они и так в конце; они
+    // проверяются по битовой карте после всех остальных фильтров.
+    std::vector<uint32_t> dense_ids;
+    while (!term_ids.empty() && idx.dense(term_ids.back())) {
+        dense_ids.insert(dense_ids.begin(), term_ids.back());
+        term_ids.pop_back();
+    }
+
+    std::vector<uint32_t> result;
+    bool have = false;
+    for (const QueryNode* c : complex) {
+        std::vector<uint32_t> part = evaluate_query(*c, idx);
+        if (!have) {
+            result = std::move(part);
+            have = true;
+        } else {
+            std::vector<uint32_t> tmp;
+            std::set_intersection(result.begin(), result.end(), part.begin(), part.end(), std::back_inserter(tmp));
+            result.swap(tmp);
+        }
+        if (result.empty()) return result;
+    }
+
+    size_t first_term = 0;
+    size_t first_range = 0;
+    size_t first_dense = 0;
+    if (!have) {
+        if (term_ids.empty() && !ranges.empty()) {
+            ranges[0].to_docs(result);
+            first_range = 1;
+        } else if (term_ids.empty() && !dense_ids.empty()) {
+            idx.dense_bitmap(dense_ids[0]).to_docs(result);
+            first_dense = 1;
+        } else if (term_ids.empty()) {
+            result.resize(idx.num_docs());
+            for (uint32_t d = 0; d < idx.num_docs(); d++) result[d] = d;
+        } else {
+            result = decode_all(idx.postings(term_ids[0]));
+            first_term = 1;
+        }
+    }
+
+    for (size_t i = first_term; i < term_ids.size() && !result.empty(); i++) {
+        PostingIterator it = idx.postings(term_ids[i]);
+        size_t out = 0;
+        for (uint32_t d : result) {
+            it.next_geq(d);
+            if (it.at_end()) break;
+            if (it.doc() == d) result[out++] = d;
+        }
+        result.resize(out);
+    }
+
+    for (size_t i = first_range; i < ranges.size() && !result.empty(); i++) {
+        result.erase(std::remove_if(result.begin(), result.end(), [&](uint32_t d) { return !ranges[i].test(d); }),
+                     result.end());
+    }
+
+    for (size_t i = first_dense; i < dense_ids.size() && !result.empty(); i++) {
+        const DocBitmapView bits = idx.dense_bitmap(dense_ids[i]);
+        result.erase(std::remove_if(result.begin(), result.end(), [&](uint32_t d) { return !bits.test(d); }),
+                     result.end());
+    }
+
+    for (const QueryNode* n : negated) {
+        if (result.empty()) break;
+        std::vector<uint32_t> part = evaluate_query(*n, idx);
+        std::vector<uint32_t> tmp;
+        std::set_difference(result.begin(), result.end(), part.begin(), part.end(), std::back_inserter(tmp));
+        result.swap(tmp);
+    }
+    return result;
+}
+
+// Отсортированный список внутренних номеров документов, подходящих под запрос.
+inline std::vector<uint32_t> evaluate_query(const QueryNode& node, const IndexReader& idx) {
+    switch (node.kind) {
+        case QueryNode::Term: {
+            const int64_t id = node_term_id(node, 0, idx);
+            if (id < 0) return {};
+            return decode_all(idx.postings((uint32_t)id));
+        }
+        case QueryNode::Phrase:
+            return evaluate_phrase(node, idx);
+        case QueryNode::And:
+            return evaluate_and(node, idx);
+        case QueryNode::Or: {
+            std::vector<uint32_t> result;
+            for (const auto& c : node.children) {
+                std::vector<uint32_t> part = evaluate_query(*c, idx);
+                std::vector<uint32_t> tmp;
+                std::set_union(result.begin(), result.end(), part.begin(), part.end(), std::back_inserter(tmp));
+                result.swap(tmp);
+            }
+            return result;
+        }
+        case QueryNode::Range: {
+            std::vector<uint32_t> result;
+            evaluate_range(node, idx).to_docs(result);
+            return result;
+        }
+        case QueryNode::Not: {
+            std::vector<uint32_t> inner = evaluate_query(*node.children[0], idx);
+            std::vector<uint32_t> result;
+            size_t j = 0;
+            for (uint32_t d = 0; d < idx.num_docs(); d++) {
+                while (j < inner.size() && inner[j] < d) j++;
+                if (j < inner.size() && inner[j] == d) continue;
+                result.push_back(d);
+            }
+            return result;
+        }
+    }
+    return {};
+}
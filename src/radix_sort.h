@@ -0,0 +1,68 @@
+#pragma once
+
+// Параллельная LSD-сортировка подсчетом по байтам для пар (uint64 ключ,
+// uint32 значение): инвертирование сортировкой в индексаторе сортирует
+// ключи (id терма << 32 | номер документа) вместе со ссылкой на позиции.
+// Проход по байту k: каждый поток считает гистограмму своего куска, по
+// гистограммам всех потоков считаются начала (цифра, поток), затем потоки
+// раскладывают свои куски в буфер независимо. Порядок внутри цифры
+// сохраняется, поэтому после всех проходов пары упорядочены по ключу.
+// Проход пропускается, если у всех ключей одинаковый байт: старшие байты
+// номера документа и id терма в небольшом индексе нулевые.
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "parallel.h"
+
+struct RadixSortStats {
+    uint32_t passes = 0;     // выполнено проходов из 8
+};
+
+inline void radix_sort_pairs(std::vector<uint64_t>& keys, std::vector<uint32_t>& vals, unsigned threads,
+                             RadixSortStats* stats = nullptr) {
+    const size_t n = keys.size();
+    if (n < 2) return;
+    threads = std::max(1u, threads);
+    std::vector<uint64_t> keys_tmp(n);
+    std::vector<uint32_t> vals_tmp(n);
+    std::vector<size_t> count((size_t)threads * 256);
+
+    for (uint32_t shift = 0; shift < 64; shift += 8) {
+        std::fill(count.begin(), count.end(), 0);
+        parallel_ranges(n, threads, [&](size_t from, size_t to, unsigned t) {
+            size_t* c = &count[(size_t)t * 256];
+            for (size_t i = from; i < to; i++) c[(keys[i] >> shift) & 0xFF]++;
+        });
+        // Все ключи в одной цифре - проход ничего не меняет.
+        bool trivial = false;
+        for (uint32_t d = 0; d < 256 && !trivial; d++) {
+            size_t total = 0;
+            for (unsigned t = 0; t < threads; t++) total += count[(size_t)t * 256 + d];
+            trivial = total == n;
+        }
+        if (trivial) continue;
+
+        // Начала кусков: цифры по порядку, внутри цифры - потоки по порядку.
+        size_t at = 0;
+        for (uint32_t d = 0; d < 256; d++) {
+            for (unsigned t = 0; t < threads; t++) {
+                const size_t c = count[(size_t)t * 256 + d];
+                count[(size_t)t * 256 + d] = at;
+                at += c;
+            }
+        }
+        parallel_ranges(n, threads, [&](size_t from, size_t to, unsigned t) {
+            size_t* next = &count[(size_t)t * 256];
+            for (size_t i = from; i < to; i++) {
+                const size_t j = next[(keys[i] >> shift) & 0xFF]++;
+                keys_tmp[j] = keys[i];
+                vals_tmp[j] = vals[i];
+            }
+        });
+        keys.swap(keys_tmp);
+        vals.swap(vals_tmp);
+        if (stats) stats->passes++;
+    }
+}
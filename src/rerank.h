@@ -0,0 +1,289 @@
+#pragma once
+
+// Второй этап ранжирования: признаки для top-N кандидатов первого этапа
+// (булев фильтр или WAND) и модель из файла.
+// Признаки лежат по столбцам (structure of arrays): модель проходит по
+// каждому столбцу подряд, без обращений к индексу.
+//
+// Формат модели (текст, '#' - комментарий):
+//   linear                          линейная модель
+//   bias <значение>
+//   weight <признак> <значение>
+//   prior <источник> <значение>     априорный вес источника (source_name)
+// или ансамбль деревьев регрессии:
+//   trees
+//   tree                            начало дерева, узлы нумеруются с 0
+//   node <признак> <порог> <левый> <правый>   x < порог -> левый
+//   leaf <значение>
+// Номера потомков больше номера узла и меньше числа узлов дерева.
+// Оценка ансамбля - сумма листьев всех деревьев (+ bias).
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "index_format.h"
+
+enum RerankFeature {
+    kFeatBm25Body,
+    kFeatBm25Title,
+    kFeatProximity,
+    kFeatLogDocLen,
+    kFeatSourcePrior,
+    kNumRerankFeatures
+};
+
+static const char* const kRerankFeatureNames[kNumRerankFeatures] = {
+    "bm25_body", "bm25_title", "proximity", "log_doc_len", "source_prior"
+};
+
+inline int rerank_feature_id(const std::string& name) {
+    for (int f = 0; f < kNumRerankFeatures; f++) {
+        if (name == kRerankFeatureNames[f]) return f;
+    }
+    return -1;
+}
+
+struct FeatureMatrix {
+    size_t rows = 0;
+    std::vector<uint32_t> docs;
+    std::vector<float> cols[kNumRerankFeatures];
+
+    void resize(size_t n) {
+        rows = n;
+        docs.resize(n);
+        for (auto& c : cols) c.assign(n, 0.0f);
+    }
+};
+
+class RerankModel {
+public:
+    bool load(const std::string& path, std::string& error) {
+        std::ifstream in(path);
+        if (!in) {
+            error = "не удалось открыть " + path;
+            return false;
+        }
+        std::string line;
+        size_t line_no = 0;
+        size_t tree_base = 0;
+        while (std::getline(in, line)) {
+            line_no++;
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            const size_t hash = line.find('#');
+            if (hash != std::string::npos) line.erase(hash);
+            std::istringstream ss(line);
+            std::string kind;
+            if (!(ss >> kind)) continue;
+
+            bool ok = true;
+            if (kind == "linear") {
+                trees_mode_ = false;
+            } else if (kind == "trees") {
+                trees_mode_ = true;
+            } else if (kind == "bias") {
+                ok = (bool)(ss >> bias_);
+            } else if (kind == "weight") {
+                std::string name;
+                float w = 0.0f;
+                ok = (bool)(ss >> name >> w);
+                const int f = rerank_feature_id(name);
+                if (ok && f >= 0) weights_[f] = w;
+                else ok = false;
+            } else if (kind == "prior") {
+                std::string source;
+                float w = 0.0f;
+                ok = (bool)(ss >> source >> w);
+                if (ok) priors_[source] = w;
+            } else if (kind == "tree") {
+                tree_base = feature_.size();
+                roots_.push_back((uint32_t)tree_base);
+            } else if (kind == "node" && !roots_.empty()) {
+                std::string name;
+                float thr = 0.0f;
+                uint32_t left = 0, right = 0;
+                ok = (bool)(ss >> name >> thr >> left >> right);
+                const int f = rerank_feature_id(name);
+                ok = ok && f >= 0;
+                if (ok) push_node(f, thr, (uint32_t)tree_base + left, (uint32_t)tree_base + right);
+            } else if (kind == "leaf" && !roots_.empty()) {
+                float v = 0.0f;
+                ok = (bool)(ss >> v);
+                if (ok) push_node(-1, v, 0, 0);
+            } else {
+                ok = false;
+            }
+            if (!ok) {
+                error = path + ":" + std::to_string(line_no) + ": не разобрана строка";
+                return false;
+            }
+        }
+        // Потомки - после родителя и внутри его дерева: любой обход от корня
+        // заканчивается в листе, циклов и переходов в другое дерево нет.
+        for (size_t t = 0; t < roots_.size(); t++) {
+            const size_t end = t + 1 < roots_.size() ? roots_[t + 1] : feature_.size();
+            if (roots_[t] == end) {
+                error = path + ": пустое дерево " + std::to_string(t);
+                return false;
+            }
+            for (size_t i = roots_[t]; i < end; i++) {
+                if (feature_[i] >= 0 && (left_[i] <= i || left_[i] >= end || right_[i] <= i || right_[i] >= end)) {
+                    error = path + ": потомки узла " + std::to_string(i - roots_[t]) + " дерева " + std::to_string(t) +
+                            " должны идти после него и внутри дерева";
+                    return false;
+                }
+            }
+        }
+        if (trees_mode_ && roots_.empty()) {
+            error = path + ": в модели нет деревьев";
+            return false;
+        }
+        return true;
+    }
+
+    float source_prior(const std::string& source) const {
+        auto it = priors_.find(source);
+        return it != priors_.end() ? it->second : 0.0f;
+    }
+
+    void score(const FeatureMatrix& m, std::vector<float>& out) const {
+        out.assign(m.rows, bias_);
+        if (!trees_mode_) {
+            for (int f = 0; f < kNumRerankFeatures; f++) {
+                const float w = weights_[f];
+                if (w == 0.0f) continue;
+                const float* col = m.cols[f].data();
+                float* dst = out.data();
+                for (size_t i = 0; i < m.rows; i++) dst[i] += w * col[i];
+            }
+            return;
+        }
+        for (uint32_t root : roots_) {
+            for (size_t i = 0; i < m.rows; i++) {
+                uint32_t n = root;
+                while (feature_[n] >= 0) {
+                    n = m.cols[feature_[n]][i] < value_[n] ? left_[n] : right_[n];
+                }
+                out[i] += value_[n];
+            }
+        }
+    }
+
+private:
+    void push_node(int feature, float value, uint32_t left, uint32_t right) {
+        feature_.push_back(feature);
+        value_.push_back(value);
+        left_.push_back(left);
+        right_.push_back(right);
+    }
+
+    bool trees_mode_ = false;
+    float bias_ = 0.0f;
+    float weights_[kNumRerankFeatures] = {};
+    std::unordered_map<std::string, float> priors_;
+
+    // Узлы всех деревьев подряд: признак (-1 - лист), порог или значение листа, потомки.
+    std::vector<int> feature_;
+    std::vector<float> value_;
+    std::vector<uint32_t> left_;
+    std::vector<uint32_t> right_;
+    std::vector<uint32_t> roots_;
+};
+
+// Наименьшее окно, в котором встречаются все термы запроса, найденные в
+// документе. Позиции термов лежат подряд в positions, позиции терма t -
+// [offsets[t], offsets[t + 1]), каждая группа отсортирована. На каждом шаге
+// сдвигается курсор терма с наименьшей позицией: O(позиций * термов), но
+// термов в запросе единицы, и промежуточная сортировка не нужна.
+inline uint32_t min_cover_span(const std::vector<uint32_t>& positions, const std::vector<uint32_t>& offsets,
+                               std::vector<uint32_t>& cursor) {
+    const size_t k = offsets.size() - 1;
+    cursor.assign(offsets.begin(), offsets.end() - 1);
+    uint32_t best = UINT32_MAX;
+    for (;;) {
+        size_t lo = 0;
+        uint32_t min_pos = UINT32_MAX, max_pos = 0;
+        for (size_t t = 0; t < k; t++) {
+            const uint32_t p = positions[cursor[t]];
+            if (p < min_pos) {
+                min_pos = p;
+                lo = t;
+            }
+            max_pos = std::max(max_pos, p);
+        }
+        best = std::min(best, max_pos - min_pos + 1);
+        if (++cursor[lo] == offsets[lo + 1]) break;
+    }
+    return best;
+}
+
+// Заполняет матрицу признаков для кандидатов. body_terms/title_terms - id
+// термов запроса в основном индексе и индексе заголовков (-1 - терма нет).
+inline void extract_rerank_features(const IndexReader& body, const IndexReader* title,
+                                    const std::vector<int64_t>& body_terms, const std::vector<int64_t>& title_terms,
+                                    std::vector<uint32_t> candidates, const std::vector<float>& doc_prior,
+                                    FeatureMatrix& m) {
+    std::sort(candidates.begin(), candidates.end());
+    m.resize(candidates.size());
+
+    std::vector<PostingIterator> body_its, title_its;
+    std::vector<float> body_idf, title_idf;
+    for (int64_t t : body_terms) {
+        if (t < 0) continue;
+        body_its.push_back(body.postings((uint32_t)t));
+        body_idf.push_back(body.posting_weight((uint32_t)t));
+    }
+    if (title) {
+        for (int64_t t : title_terms) {
+            if (t < 0) continue;
+            title_its.push_back(title->postings((uint32_t)t));
+            title_idf.push_back(title->posting_weight((uint32_t)t));
+        }
+    }
+
+    std::vector<uint32_t> pos, positions, offsets, cursor;
+    for (size_t i = 0; i < candidates.size(); i++) {
+        const uint32_t d = candidates[i];
+        m.docs[i] = d;
+
+        float bm25 = 0.0f;
+        positions.clear();
+        offsets.assign(1, 0);
+        const float norm = body.doc_norm(d);
+        for (size_t t = 0; t < body_its.size(); t++) {
+            body_its[t].next_geq(d);
+            if (body_its[t].doc() != d) continue;
+            bm25 += body_idf[t] * body.posting_score(body_its[t], norm);
+            body_its[t].positions(pos);
+            if (pos.empty()) continue;
+            positions.insert(positions.end(), pos.begin(), pos.end());
+            offsets.push_back((uint32_t)positions.size());
+        }
+        m.cols[kFeatBm25Body][i] = bm25;
+
+        // Близость: число найденных термов на длину покрывающего их окна.
+        const size_t present = offsets.size() - 1;
+        if (present >= 2) {
+            const uint32_t span = min_cover_span(positions, offsets, cursor);
+            m.cols[kFeatProximity][i] = (float)present / (float)span;
+        }
+
+        if (title) {
+            float tb = 0.0f;
+            const float tnorm = title->doc_norm(d);
+            for (size_t t = 0; t < title_its.size(); t++) {
+                title_its[t].next_geq(d);
+                if (title_its[t].doc() == d) tb += title_idf[t] * title->posting_score(title_its[t], tnorm);
+            }
+            m.cols[kFeatBm25Title][i] = tb;
+        }
+
+        m.cols[kFeatLogDocLen][i] = std::log1p((float)body.doc_len(d));
+        m.cols[kFeatSourcePrior][i] = d < doc_prior.size() ? doc_prior[d] : 0.0f;
+    }
+}
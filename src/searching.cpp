@@ -2,228 +2,393 @@
 #include <fstream>
 #include <string>
 #include <vector>
-#include <set>
-#include <sstream>
+#include <unordered_map>
 #include <algorithm>
+#include <filesystem>
 #include <json/json.h>
 
-std::string to_lower(const std::string& s) {
-    std::string result = s;
-    std::transform(result.begin(), result.end(), result.begin(), ::tolower);
-    return result;
-}
-
-struct DirectIndex {
-    std::string doc_id;
-    std::string title;
-    std::string url;
-};
-
-struct InvertedIndex {
-    std::string term;
-    std::vector<std::string> doc_ids;
+#include "feedback.h"
+#include "impact_index.h"
+#include "index_format.h"
+#include "metrics.h"
+#include "qrels.h"
+#include "query.h"
+#include "rerank.h"
+#include "topk.h"
+
+// Сколько термов документа-образца идет в запрос "похожих".
+static constexpr size_t kMoreLikeThisTerms = 20;
+
+struct SearchOptions {
+    std::string query_file;
+    std::string index_dir = "data";
+    bool ranked = false;
+    size_t topk = 10;
+    bool prf = false;
+    RocchioParams rocchio;
+    size_t cache_postings = 4u << 20;
+    std::string qrels_path;
+    std::string run_path;
+    std::string run_tag = "searching";
+    std::string rerank_model;
+    size_t candidates = 1000;
+    float static_weight = 1.0f;   // вес статического ранга в оценке (0 - чистый BM25)
+    bool saat = false;            // дизъюнкции - по индексу вкладов (impact_index.h)
+    uint64_t saat_budget = 0;     // предел постингов на запрос, 0 - без предела
 };
 
-void load_direct_index(const std::string &filename, std::vector<DirectIndex> &direct_index) {
-    std::ifstream infile(filename, std::ios::binary);
-    if (!infile) {
-        std::cerr << "Не удалось открыть файл прямого индекса!" << std::endl;
-        return;
+// Термы запроса вне отрицаний с весом = числом вхождений.
+static std::vector<WeightedTerm> weighted_query_terms(const QueryNode& root, const IndexReader& index) {
+    std::vector<uint32_t> ids;
+    collect_positive_ids(root, index, ids);
+    std::vector<WeightedTerm> terms;
+    for (uint32_t id : ids) {
+        auto t = std::find_if(terms.begin(), terms.end(), [id](const WeightedTerm& x) { return x.term == (uint32_t)id; });
+        if (t != terms.end()) t->weight += 1.0f;
+        else terms.push_back({(uint32_t)id, 1.0f});
     }
+    return terms;
+}
 
-    while (infile) {
-        DirectIndex doc;
-        uint64_t title_size, url_size;
-
-        infile.read(reinterpret_cast<char*>(&title_size), sizeof(title_size));
-        if (infile.eof()) break;
-
-        doc.title.resize(title_size);
-        infile.read(&doc.title[0], title_size);
-
-        infile.read(reinterpret_cast<char*>(&url_size), sizeof(url_size));
-        doc.url.resize(url_size);
-        infile.read(&doc.url[0], url_size);
+int main(int argc, char *argv[]) {
+    SearchOptions opt;
+    for (int i = 1; i < argc; i++) {
+        const std::string a = argv[i];
+        if (a == "--ranked") opt.ranked = true;
+        else if (a == "--topk" && i + 1 < argc) opt.topk = std::stoul(argv[++i]);
+        else if (a == "--index" && i + 1 < argc) opt.index_dir = argv[++i];
+        else if (a == "--prf" && i + 1 < argc) { opt.prf = opt.ranked = true; opt.rocchio.docs = std::stoul(argv[++i]); }
+        else if (a == "--prf-terms" && i + 1 < argc) opt.rocchio.expansion = std::stoul(argv[++i]);
+        else if (a == "--prf-beta" && i + 1 < argc) opt.rocchio.beta = std::stof(argv[++i]);
+        else if (a == "--cache-postings" && i + 1 < argc) opt.cache_postings = std::stoul(argv[++i]);
+        else if (a == "--qrels" && i + 1 < argc) opt.qrels_path = argv[++i];
+        else if (a == "--run" && i + 1 < argc) opt.run_path = argv[++i];
+        else if (a == "--run-tag" && i + 1 < argc) opt.run_tag = argv[++i];
+        else if (a == "--rerank" && i + 1 < argc) { opt.rerank_model = argv[++i]; opt.ranked = true; }
+        else if (a == "--candidates" && i + 1 < argc) opt.candidates = std::stoul(argv[++i]);
+        else if (a == "--static-weight" && i + 1 < argc) opt.static_weight = std::stof(argv[++i]);
+        else if (a == "--saat") opt.saat = opt.ranked = true;
+        else if (a == "--saat-budget" && i + 1 < argc) { opt.saat_budget = std::stoull(argv[++i]); opt.saat = opt.ranked = true; }
+        else opt.query_file = a;
+    }
+    if (opt.query_file.empty()) {
+        std::cerr << "Не указан путь к файлу с запросами." << std::endl;
+        std::cerr << "Использование: searching [--ranked] [--topk N] [--index dir] [--prf R] [--prf-terms E]"
+                  << " [--qrels qrels.tsv] [--run run.txt [--run-tag tag]] [--rerank model.txt [--candidates N]]"
+                  << " [--static-weight W] [--saat [--saat-budget N]] <queries.txt>" << std::endl;
+        return 1;
+    }
 
-        uint64_t doc_id_size;
-        infile.read(reinterpret_cast<char*>(&doc_id_size), sizeof(doc_id_size));
-        doc.doc_id.resize(doc_id_size);
-        infile.read(&doc.doc_id[0], doc_id_size);
+    std::ifstream infile(opt.query_file);
+    if (!infile.is_open()) {
+        std::cerr << "Не удалось открыть файл с запросами." << std::endl;
+        return 1;
+    }
 
-        direct_index.push_back(doc);
+    metrics::Registry reg("searching");
+    auto& m_queries = reg.counter("queries_total", "Обработано запросов");
+    auto& m_empty = reg.counter("empty_results_total", "Запросов без результатов");
+    auto& m_results = reg.counter("results_total", "Выдано документов");
+    auto& m_scored = reg.counter("docs_scored_total", "Документов с посчитанной оценкой BM25");
+    auto& m_skipped = reg.counter("wand_skips_total", "Пропусков документов через next_geq в WAND");
+    auto& m_early = reg.counter("static_rank_early_stops_total", "Обходов top-k, остановленных по статическому рангу");
+    auto& m_latency = reg.histogram("query_latency_us", "Время выполнения запроса, мкс");
+
+    Qrels qrels;
+    if (!opt.qrels_path.empty() && !load_qrels(opt.qrels_path, qrels)) {
+        std::cerr << "Не удалось открыть файл оценок " << opt.qrels_path << std::endl;
+        return 1;
     }
-}
 
-void load_inverted_index(const std::string &filename, std::vector<InvertedIndex> &inverted_index) {
-    std::ifstream infile(filename, std::ios::binary);
-    if (!infile) {
+    metrics::Timer load_timer;
+    std::vector<DirectIndex> direct_index;
+    IndexReader index;
+    if (!load_direct_index(opt.index_dir + "/direct_index.bin", direct_index)) {
+        std::cerr << "Не удалось открыть файл прямого индекса!" << std::endl;
+        return 1;
+    }
+    if (!index.open(opt.index_dir)) {
         std::cerr << "Не удалось открыть файл обратного индекса!" << std::endl;
-        return;
+        return 1;
     }
+    if (direct_index.size() != index.num_docs()) {
+        std::cerr << "Прямой и обратный индексы не согласованы!" << std::endl;
+        return 1;
+    }
+    std::unordered_map<std::string, uint32_t> doc_ord;
+    for (uint32_t d = 0; d < direct_index.size(); d++) doc_ord.emplace(direct_index[d].doc_id, d);
+    reg.gauge("index_load_seconds", "Время загрузки индекса, с").set(load_timer.seconds());
+    reg.gauge("index_docs", "Документов в прямом индексе").set((double)direct_index.size());
+    reg.gauge("index_terms", "Термов в обратном индексе").set((double)index.num_terms());
+    const StaticPrior prior{index.static_rank(), opt.static_weight};
+
+    ImpactIndex impact_index;
+    if (opt.saat && (!impact_index.open(opt.index_dir + "/impact_index.bin") ||
+                     impact_index.num_docs() != index.num_docs() || impact_index.num_terms() != index.num_terms())) {
+        std::cerr << "Индекс вкладов не найден или не согласован с индексом (indexer --impacts)." << std::endl;
+        return 1;
+    }
+    SaatEvaluator saat(impact_index);
+    auto& m_saat_postings = reg.counter("saat_postings_total", "Постингов, обработанных вычислением по оценкам");
+    auto& m_saat_truncated = reg.counter("saat_truncated_total", "Запросов, прерванных бюджетом постингов");
 
-    while (infile) {
-        InvertedIndex term;
-        uint64_t term_size, doc_count;
-
-        infile.read(reinterpret_cast<char*>(&term_size), sizeof(term_size));
-        if (infile.eof()) break;
-
-        term.term.resize(term_size);
-        infile.read(&term.term[0], term_size);
-
-        infile.read(reinterpret_cast<char*>(&doc_count), sizeof(doc_count));
+    if (opt.prf && !index.has_forward()) {
+        std::cerr << "Для обратной связи нужен прямой индекс векторов (forward_index.bin)." << std::endl;
+        return 1;
+    }
 
-        term.doc_ids.resize(doc_count);
-        for (size_t i = 0; i < doc_count; ++i) {
-            uint64_t doc_id_size;
-            infile.read(reinterpret_cast<char*>(&doc_id_size), sizeof(doc_id_size));
-            term.doc_ids[i].resize(doc_id_size);
-            infile.read(&term.doc_ids[i][0], doc_id_size);
+    // Выдача для eval: TREC run и рядом задержка каждого запроса (<run>.latency).
+    std::ofstream run_out, latency_out;
+    if (!opt.run_path.empty()) {
+        const std::filesystem::path run_dir = std::filesystem::path(opt.run_path).parent_path();
+        if (!run_dir.empty()) std::filesystem::create_directories(run_dir);
+        run_out.open(opt.run_path);
+        latency_out.open(opt.run_path + ".latency");
+        if (!run_out || !latency_out) {
+            std::cerr << "Не удалось открыть файл выдачи " << opt.run_path << std::endl;
+            return 1;
         }
-
-        inverted_index.push_back(term);
     }
-}
+    size_t query_no = 0;
+
+    // Двухэтапное ранжирование: первый этап отдает top-N кандидатов,
+    // второй пересчитывает их оценку моделью по признакам.
+    RerankModel model;
+    IndexReader title_index;
+    std::vector<float> doc_prior;
+    const bool rerank = !opt.rerank_model.empty();
+    if (rerank) {
+        std::string error;
+        if (!model.load(opt.rerank_model, error)) {
+            std::cerr << "Модель переранжирования: " << error << std::endl;
+            return 1;
+        }
+        if (!title_index.open_file(opt.index_dir + "/title_index.bin") || title_index.num_docs() != index.num_docs()) {
+            std::cerr << "Индекс заголовков не найден, признак bm25_title будет нулевым." << std::endl;
+            title_index = IndexReader();
+        }
+        doc_prior.resize(direct_index.size());
+        for (uint32_t d = 0; d < direct_index.size(); d++) doc_prior[d] = model.source_prior(direct_index[d].source);
+    }
+    const size_t stage1_k = rerank ? std::max(opt.candidates, opt.topk) : opt.topk;
+    auto& m_features_us = reg.histogram("rerank_features_us", "Извлечение признаков кандидатов, мкс");
+    auto& m_model_us = reg.histogram("rerank_model_us", "Применение модели к кандидатам, мкс");
+    auto& m_candidates = reg.counter("rerank_candidates_total", "Кандидатов второго этапа");
+    FeatureMatrix features;
+    std::vector<float> rerank_scores;
+
+    const std::string kSimilarPrefix = "similar:";
+    PostingCache cache(opt.cache_postings);
+    auto& m_first_us = reg.histogram("prf_first_pass_us", "Первый проход (до расширения), мкс");
+    auto& m_second_us = reg.histogram("prf_second_pass_us", "Расширение Rocchio и второй проход, мкс");
+
+    // Recall по темам из qrels: без обратной связи и с ней.
+    double recall_base_sum = 0.0;
+    double recall_prf_sum = 0.0;
+    size_t judged_topics = 0;
+    auto ranked_ids = [&](const std::vector<ScoredDoc>& docs) {
+        std::vector<std::string> ids;
+        for (size_t i = 0; i < docs.size() && i < opt.topk; i++) ids.push_back(direct_index[docs[i].doc].doc_id);
+        return ids;
+    };
+
+    std::string query;
+    while (std::getline(infile, query)) {
+        if (!query.empty() && query.back() == '\r') query.pop_back();
+        if (query.empty()) continue;
 
-std::vector<std::string> parse_query(const std::string &query) {
-    std::vector<std::string> tokens;
-    std::string token;
-    bool in_quotes = false;
-
-    for (size_t i = 0; i < query.size(); ++i) {
-        char c = query[i];
-
-        if (c == '"' && !in_quotes) {
-            in_quotes = true;
-        } else if (c == '"' && in_quotes) {
-            in_quotes = false;
-        } else if ((c == ' ' || c == '(' || c == ')') && !in_quotes) {
-            if (!token.empty()) {
-                tokens.push_back(token);
-                token.clear();
+        // Строка темы: "topic_id<TAB>запрос".
+        std::string topic;
+        const size_t tab = query.find('\t');
+        if (tab != std::string::npos) {
+            topic = query.substr(0, tab);
+            query = query.substr(tab + 1);
+        }
+        query_no++;
+        if (topic.empty()) topic = "q" + std::to_string(query_no);
+        auto judged = qrels.find(topic);
+
+        metrics::Timer query_timer;
+        TopKStats stats;
+        std::vector<ScoredDoc> ranked;
+        std::vector<uint32_t> result;
+        bool scored = opt.ranked;
+
+        if (query.compare(0, kSimilarPrefix.size(), kSimilarPrefix) == 0) {
+            // "Больше похожих": вектор документа из прямого индекса -> взвешенный WAND.
+            scored = true;
+            const std::string doc_id = query.substr(kSimilarPrefix.size());
+            auto it = doc_ord.find(doc_id);
+            if (it == doc_ord.end() || !index.has_forward()) {
+                std::cerr << "Документ " << doc_id << " не найден в прямом индексе." << std::endl;
+            } else {
+                std::vector<WeightedTerm> terms = more_like_this_terms(index, it->second, kMoreLikeThisTerms);
+                ranked = wand_topk(index, terms, opt.topk, it->second, &stats, prior);
             }
-        } else if (c == '&' || c == '|' || c == '!') {
-            if (!token.empty()) {
-                tokens.push_back(token);
-                token.clear();
+        } else if (QueryPtr root = QueryParser(query).parse()) {
+            expand_query(root, index);
+            if (!opt.ranked) {
+                result = evaluate_query(*root, index);
+            } else if (!opt.prf) {
+                std::vector<WeightedTerm> terms = weighted_query_terms(*root, index);
+                if (opt.saat && is_pure_disjunction(*root)) {
+                    SaatStats saat_stats;
+                    ranked = saat.topk(terms, stage1_k, opt.saat_budget, &saat_stats, prior);
+                    m_saat_postings.inc(saat_stats.postings);
+                    if (saat_stats.truncated) m_saat_truncated.inc();
+                } else if (is_pure_disjunction(*root)) {
+                    ranked = wand_topk(index, terms, stage1_k, kEndDoc, &stats, prior);
+                } else {
+                    ranked = score_docs(index, terms, evaluate_query(*root, index), stage1_k, &stats, prior);
+                }
+            } else {
+                // Второй проход - дизъюнкция расширенного запроса: булевы
+                // ограничения исходного запроса действуют только на первом проходе.
+                metrics::Timer pass_timer;
+                std::vector<WeightedTerm> terms = weighted_query_terms(*root, index);
+                const size_t first_k = std::max(opt.topk, opt.rocchio.docs);
+                std::vector<ScoredDoc> first = is_pure_disjunction(*root)
+                    ? wand_topk_cached(index, cache, terms, first_k, &stats, prior)
+                    : score_docs(index, terms, evaluate_query(*root, index), first_k, &stats, prior);
+                m_first_us.record(pass_timer.us());
+
+                pass_timer.reset();
+                std::vector<WeightedTerm> expanded = rocchio_expand(index, terms, first, opt.rocchio);
+                ranked = wand_topk_cached(index, cache, expanded, stage1_k, &stats, prior);
+                m_second_us.record(pass_timer.us());
+
+                if (judged != qrels.end()) recall_base_sum += recall_at(judged->second, ranked_ids(first), opt.topk);
             }
 
-            if (i + 1 < query.size() && query[i + 1] == c) {
-                tokens.push_back(std::string(1, c) + c);
-                ++i;
-            } else {
-                tokens.push_back(std::string(1, c));
+            if (rerank && !ranked.empty()) {
+                std::vector<std::string> words;
+                collect_positive_terms(*root, index, words);
+                std::sort(words.begin(), words.end());
+                words.erase(std::unique(words.begin(), words.end()), words.end());
+                std::vector<int64_t> body_terms, title_terms;
+                for (const auto& w : words) {
+                    body_terms.push_back(index.lookup(w));
+                    title_terms.push_back(title_index.num_terms() ? title_index.lookup(w) : -1);
+                }
+                std::vector<uint32_t> candidates;
+                for (const auto& r : ranked) candidates.push_back(r.doc);
+
+                metrics::Timer stage_timer;
+                extract_rerank_features(index, title_index.num_terms() ? &title_index : nullptr, body_terms, title_terms,
+                                        candidates, doc_prior, features);
+                m_features_us.record(stage_timer.ns() / 1000);
+                stage_timer.reset();
+                model.score(features, rerank_scores);
+                TopKHeap heap(opt.topk);
+                for (size_t i = 0; i < features.rows; i++) heap.push(features.docs[i], rerank_scores[i]);
+                ranked = heap.take();
+                m_model_us.record(stage_timer.ns() / 1000);
+                m_candidates.inc(candidates.size());
             }
-        } else {
-            token += c;
         }
-    }
-
-    if (!token.empty()) {
-        tokens.push_back(token);
-    }
-
-    return tokens;
-}
-
-std::vector<std::string> and_operation(const std::vector<std::string> &left, const std::vector<std::string> &right) {
-    std::vector<std::string> result;
-    if (left.empty() || right.empty()) return result;
-    std::set_intersection(left.begin(), left.end(), right.begin(), right.end(), std::back_inserter(result));
-    return result;
-}
-
-std::vector<std::string> or_operation(const std::vector<std::string> &left, const std::vector<std::string> &right) {
-    std::vector<std::string> result;
-    if (left.empty() || right.empty()) return result;
-    std::set_union(left.begin(), left.end(), right.begin(), right.end(), std::back_inserter(result));
-    return result;
-}
-
-std::vector<std::string> not_operation(const std::vector<std::string> &left, const std::vector<std::string> &right) {
-    std::vector<std::string> result;
-    if (left.empty()) return result;
-    std::set_difference(left.begin(), left.end(), right.begin(), right.end(), std::back_inserter(result));
-    return result;
-}
-
-std::vector<std::string> boolean_search(const std::string &query, const std::vector<InvertedIndex> &inverted_index, const std::vector<DirectIndex> &direct_index) {
-    auto tokens = parse_query(query);
-    std::vector<std::vector<std::string>> stack;
-
-    for (const std::string &token : tokens) {
-        if (token == "&&" || token == "||" || token == "!") {
-            if (stack.size() < 2) continue;
 
-            std::vector<std::string> right = stack.back(); stack.pop_back();
-            std::vector<std::string> left = stack.back(); stack.pop_back();
-            std::vector<std::string> result;
+        const uint64_t latency_us = query_timer.us();
+        m_latency.record(latency_us);
+        m_queries.inc();
+        m_scored.inc(stats.scored);
+        m_skipped.inc(stats.skipped);
+        m_early.inc(stats.early_stops);
+        const size_t found = scored ? ranked.size() : result.size();
+        m_results.inc(found);
+
+        if (run_out.is_open()) {
+            latency_out << topic << '\t' << latency_us << '\n';
+            if (scored) {
+                for (size_t i = 0; i < ranked.size(); i++) {
+                    run_out << topic << " Q0 " << direct_index[ranked[i].doc].doc_id << ' ' << i + 1 << ' '
+                            << ranked[i].score << ' ' << opt.run_tag << '\n';
+                }
+            } else {
+                // У булевой выдачи нет оценки: ранг - порядок документов.
+                for (size_t i = 0; i < result.size(); i++) {
+                    run_out << topic << " Q0 " << direct_index[result[i]].doc_id << ' ' << i + 1 << " 0 "
+                            << opt.run_tag << '\n';
+                }
+            }
+        }
 
-            if (token == "&&") {
-                result = and_operation(left, right);
-            } else if (token == "||") {
-                result = or_operation(left, right);
-            } else if (token == "!") {
-                result = not_operation(left, right);
+        if (judged != qrels.end()) {
+            std::vector<std::string> ids;
+            if (scored) {
+                ids = ranked_ids(ranked);
+            } else {
+                for (size_t i = 0; i < result.size() && i < opt.topk; i++) ids.push_back(direct_index[result[i]].doc_id);
             }
+            const double recall = recall_at(judged->second, ids, opt.topk);
+            recall_prf_sum += recall;
+            if (!opt.prf) recall_base_sum += recall;
+            judged_topics++;
+        }
 
-            stack.push_back(result);
+        if (found == 0) {
+            m_empty.inc();
+            std::cout << "По запросу '" << query << "' ничего не найдено." << std::endl;
+        } else if (scored) {
+            for (const auto& r : ranked) {
+                const DirectIndex& doc = direct_index[r.doc];
+                std::cout << "Документ: " << doc.doc_id << " | Оценка: " << r.score
+                          << " | Заголовок: " << doc.title << " | Ссылка: " << doc.url << std::endl;
+            }
         } else {
-            bool found = false;
-            for (const auto &entry : inverted_index) {
-                if (entry.term == token) {
-                    stack.push_back(entry.doc_ids);
-                    found = true;
-                    break;
-                }
+            for (uint32_t d : result) {
+                const DirectIndex& doc = direct_index[d];
+                std::cout << "Документ: " << doc.doc_id << " | Заголовок: " << doc.title << " | Ссылка: " << doc.url << std::endl;
             }
-            if (!found) continue;
         }
+        std::cout << std::endl;
     }
 
-    if (stack.empty()) return {};
-
-    return stack.back();
-}
-
-int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        std::cerr << "Не указан путь к файлу с запросами." << std::endl;
-        return 1;
+    if (opt.prf) {
+        reg.counter("posting_cache_hits_total", "Списки, взятые из кеша распакованных").inc(cache.hits());
+        reg.counter("posting_cache_misses_total", "Списки, распакованные заново").inc(cache.misses());
+        std::cout << "Обратная связь (Rocchio, R=" << opt.rocchio.docs << ", термов +" << opt.rocchio.expansion << "): "
+                  << "первый проход p50 " << m_first_us.percentile(0.5) << " мкс, второй p50 "
+                  << m_second_us.percentile(0.5) << " мкс, кеш " << cache.hits() << "/" << (cache.hits() + cache.misses())
+                  << " попаданий" << std::endl;
     }
-
-    std::string query_file = argv[1];
-    std::ifstream infile(query_file);
-    if (!infile.is_open()) {
-        std::cerr << "Не удалось открыть файл с запросами." << std::endl;
-        return 1;
+    if (rerank && m_features_us.count() > 0) {
+        std::cout << "Переранжирование: признаки p50 " << m_features_us.percentile(0.5) << " мкс, модель p50 "
+                  << m_model_us.percentile(0.5) << " мкс, p99 " << m_model_us.percentile(0.99) << " мкс" << std::endl;
     }
-
-    std::vector<DirectIndex> direct_index;
-    std::vector<InvertedIndex> inverted_index;
-    load_direct_index("data/direct_index.bin", direct_index);
-    load_inverted_index("data/inverted_index.bin", inverted_index);
-
-    std::string query;
-    while (std::getline(infile, query)) {
-        if (query.empty()) continue;
-
-        std::vector<std::string> result = boolean_search(query, inverted_index, direct_index);
-
-        if (result.empty()) {
-            std::cout << "По запросу '" << query << "' ничего не найдено." << std::endl;
-        } else {
-            for (const auto& doc_id : result) {
-                auto it = std::find_if(direct_index.begin(), direct_index.end(), [doc_id](const DirectIndex &doc) {
-                    return doc.doc_id == doc_id;
-                });
-                if (it != direct_index.end()) {
-                    std::cout << "Документ: " << doc_id << " | Заголовок: " << it->title << " | Ссылка: " << it->url << std::endl;
-                }
-            }
+    // Фильтры Блума основного индекса, биграмм и заголовков: сколько поисков
+    // отсутствующих термов закончилось без словаря.
+    BloomStats bloom;
+    const IndexReader* readers[] = {&index, index.biwords(), &title_index};
+    for (const IndexReader* r : readers) {
+        if (!r) continue;
+        bloom.lookups += r->bloom_stats().lookups;
+        bloom.rejected += r->bloom_stats().rejected;
+        bloom.false_positives += r->bloom_stats().false_positives;
+    }
+    if (bloom.lookups > 0) {
+        reg.counter("bloom_lookups_total", "Проверок фильтров Блума по термам").inc(bloom.lookups);
+        reg.counter("bloom_rejected_total", "Поисков термов, законченных фильтром Блума без словаря").inc(bloom.rejected);
+        reg.counter("bloom_false_positives_total", "Отсутствующих термов, пропущенных фильтром Блума").inc(bloom.false_positives);
+        reg.gauge("bloom_fpr", "Доля ложных срабатываний фильтра Блума среди отсутствующих термов").set(bloom.fpr());
+        std::cout << "Фильтр Блума: проверок " << bloom.lookups << ", без обращения к словарю " << bloom.rejected
+                  << ", ложных срабатываний " << bloom.false_positives << " (FPR " << bloom.fpr() << ")" << std::endl;
+    }
+    if (judged_topics > 0) {
+        const double base = recall_base_sum / judged_topics;
+        const double with_prf = recall_prf_sum / judged_topics;
+        reg.gauge("recall_at_k", "Средний recall@k по темам qrels").set(with_prf);
+        std::cout << "Тем с оценками: " << judged_topics << ", recall@" << opt.topk << ": " << base;
+        if (opt.prf) {
+            reg.gauge("recall_at_k_base", "Средний recall@k без обратной связи").set(base);
+            std::cout << " -> " << with_prf << " с обратной связью";
         }
         std::cout << std::endl;
     }
 
+    // Текстовый формат Prometheus: файл подхватывается textfile-коллектором node_exporter.
+    if (!metrics::dump_json(reg) || !metrics::dump_prometheus(reg, metrics::metrics_dir() / "searching.prom")) {
+        std::cerr << "Не удалось записать метрики в " << metrics::metrics_dir() << std::endl;
+    }
+
     return 0;
 }
@@ -0,0 +1,96 @@
+#pragma once
+
+// Статический ранг документа - оценка качества, не зависящая от запроса:
+// длина текста, априорный вес источника и число входящих ссылок из корпуса.
+// Индексатор нумерует документы по убыванию ранга и пишет ранг в [0, 1]
+// рядом с длинами документов (kIndexHasStaticRank). Итоговая оценка
+// документа - BM25 + weight * ранг; раз ранг не возрастает с номером
+// документа, top-k обход может остановиться, как только верхняя граница
+// BM25 плюс ранг текущего документа не превышает порога кучи (topk.h).
+//
+// Ссылки: в JSONL - массив "links" (export_corpus.py), в дампе mongodump
+// они извлекаются из raw_html (extract_links). Ссылка нормализуется как
+// normalized_url в database.py: абсолютный URL без '#...' и '?...'.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct StaticRankOptions {
+    bool enabled = true;
+    float length_weight = 1.0f;
+    float links_weight = 1.0f;
+    float source_weight = 1.0f;
+    std::unordered_map<std::string, float> source_prior = {{"Wikipedia", 1.0f}, {"BRE", 1.0f}};
+};
+
+// Ключ нормализованного URL: ссылки хранятся хешами, а не строками.
+inline uint64_t link_key(std::string_view url) {
+    return std::hash<std::string_view>()(url);
+}
+
+inline std::string_view strip_url_tail(std::string_view url) {
+    const size_t cut = url.find_first_of("#?");
+    return cut == std::string_view::npos ? url : url.substr(0, cut);
+}
+
+// Абсолютный нормализованный URL ссылки href со страницы base; пусто для
+// якорей, mailto:, javascript: и относительных путей без '/'.
+inline std::string resolve_link(std::string_view href, std::string_view base) {
+    href = strip_url_tail(href);
+    if (href.empty()) return {};
+    if (href.compare(0, 7, "http://") == 0 || href.compare(0, 8, "https://") == 0) return std::string(href);
+    const size_t scheme = base.find("://");
+    if (scheme == std::string_view::npos) return {};
+    if (href.compare(0, 2, "//") == 0) return std::string(base.substr(0, scheme + 1)).append(href);
+    if (href[0] != '/') return {};
+    const size_t host_end = base.find('/', scheme + 3);
+    return std::string(base.substr(0, host_end)).append(href);
+}
+
+// Ключи ссылок <a href="..."> из HTML страницы с адресом base_url.
+inline void extract_links(std::string_view html, std::string_view base_url, std::vector<uint64_t>& out) {
+    static constexpr std::string_view kHref = "href=";
+    for (size_t at = html.find(kHref); at != std::string_view::npos; at = html.find(kHref, at)) {
+        at += kHref.size();
+        if (at >= html.size()) break;
+        const char quote = html[at];
+        if (quote != '"' && quote != '\'') continue;
+        const size_t end = html.find(quote, at + 1);
+        if (end == std::string_view::npos) break;
+        const std::string url = resolve_link(html.substr(at + 1, end - at - 1), base_url);
+        if (!url.empty()) out.push_back(link_key(url));
+        at = end + 1;
+    }
+}
+
+// Ранг по длине (слов), источнику и числу входящих ссылок. Длина и ссылки
+// берутся в логарифме и делятся на максимум по корпусу, итог - взвешенное
+// среднее трех слагаемых в [0, 1].
+inline std::vector<float> compute_static_rank(const StaticRankOptions& opt, const std::vector<uint32_t>& words,
+                                              const std::vector<std::string>& sources,
+                                              const std::vector<uint32_t>& inlinks) {
+    const size_t n = words.size();
+    double max_len = 0.0, max_links = 0.0;
+    for (size_t d = 0; d < n; d++) {
+        max_len = std::max(max_len, std::log1p((double)words[d]));
+        max_links = std::max(max_links, std::log1p((double)inlinks[d]));
+    }
+    const double total = opt.length_weight + opt.links_weight + opt.source_weight;
+    std::vector<float> rank(n, 0.0f);
+    if (total <= 0.0) return rank;
+    for (size_t d = 0; d < n; d++) {
+        double s = 0.0;
+        if (max_len > 0.0) s += opt.length_weight * std::log1p((double)words[d]) / max_len;
+        if (max_links > 0.0) s += opt.links_weight * std::log1p((double)inlinks[d]) / max_links;
+        auto prior = opt.source_prior.find(sources[d]);
+        if (prior != opt.source_prior.end()) s += opt.source_weight * std::clamp(prior->second, 0.0f, 1.0f);
+        rank[d] = (float)(s / total);
+    }
+    return rank;
+}
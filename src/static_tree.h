@@ -0,0 +1,76 @@
+#pragma once
+
+// Статическое дерево поиска в раскладке Эйтцингера для упорядоченных
+// операций (lower_bound) над неизменяемым отсортированным массивом ключей.
+// Ключи лежат в порядке обхода полного двоичного дерева в ширину: у узла k
+// потомки 2k и 2k + 1. Верхние уровни занимают несколько кэш-линий и
+// остаются в кэше, а узлы на kPrefetchLevels уровней ниже текущего лежат в
+// одной кэш-линии, которая загружается заранее (__builtin_prefetch) - промахи
+// кэша идут параллельно, а не по одному на шаг, как у std::lower_bound.
+//
+// Для словаря ключ терма - первые 8 байт строки (key_prefix): сравнение
+// таких ключей как чисел согласовано с порядком строк.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Старшие байты - первые байты строки, недостающие - нули.
+inline uint64_t key_prefix(std::string_view s) {
+    uint64_t k = 0;
+    for (size_t i = 0; i < 8; i++) {
+        k = (k << 8) | (i < s.size() ? (uint8_t)s[i] : 0);
+    }
+    return k;
+}
+
+class EytzingerTree {
+public:
+    static constexpr size_t kLineKeys = 64 / sizeof(uint64_t);
+    static constexpr unsigned kPrefetchLevels = 3;   // 2^3 = kLineKeys потомков
+
+    // sorted - ключи по неубыванию.
+    void build(const uint64_t* sorted, size_t n) {
+        n_ = n;
+        // Узлы с 1; запас под выравнивание по кэш-линии.
+        storage_.assign(n + 1 + 2 * kLineKeys, 0);
+        const size_t skew = (64 - reinterpret_cast<uintptr_t>(storage_.data()) % 64) % 64 / sizeof(uint64_t);
+        // Узел 0 (пустой) - в начале кэш-линии: тогда потомки
+        // kLineKeys * k .. +7 на kPrefetchLevels уровней ниже лежат в одной линии.
+        base_ = skew;
+        rank_.assign(n + 1, 0);
+        size_t i = 0;
+        fill(sorted, i, 1);
+    }
+
+    size_t size() const { return n_; }
+
+    // Номер в отсортированном массиве первого ключа >= x, size(), если такого нет.
+    size_t lower_bound(uint64_t x) const {
+        const uint64_t* tree = storage_.data() + base_;
+        size_t k = 1;
+        while (k <= n_) {
+            __builtin_prefetch(tree + std::min(k << kPrefetchLevels, n_));
+            k = 2 * k + (tree[k] < x);
+        }
+        // Подняться до последнего поворота налево.
+        k >>= __builtin_ffsll((long long)~k);
+        return k ? rank_[k] : n_;
+    }
+
+private:
+    void fill(const uint64_t* sorted, size_t& i, size_t k) {
+        if (k > n_) return;
+        fill(sorted, i, 2 * k);
+        storage_[base_ + k] = sorted[i];
+        rank_[k] = (uint32_t)i++;
+        fill(sorted, i, 2 * k + 1);
+    }
+
+    size_t n_ = 0;
+    std::vector<uint64_t> storage_;
+    size_t base_ = 0;   // смещение узла 0 в storage_
+    std::vector<uint32_t> rank_;
+};
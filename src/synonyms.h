@@ -0,0 +1,149 @@
+#pragma once
+
+// Синонимы и термины-эквиваленты из словаря предметной области.
+// Файл синонимов (synonyms.txt): одна группа на строку, варианты через
+// запятую, '#' - комментарий:
+//   днк, дезоксирибонуклеиновая кислота
+// Индексатор нормализует варианты так же, как запросы (normalize_query_text),
+// разрешает их в id термов и пишет таблицу data/synonyms.bin:
+//   "SYN1", uint32 n ключей,
+//   n x uint32 id терма-ключа по возрастанию,
+//   (n + 1) x uint32 смещений в массиве вариантов (в uint32),
+//   варианты: uint32 k, k x uint32 id термов, k x uint32 смещений слов.
+// Ключ - вариант из одного слова; вариант из нескольких слов - фраза.
+// Поисковику остается двоичный поиск по id: строки при расширении запроса
+// не разбираются и в словаре не ищутся.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "mmap_file.h"
+#include "text_ru.h"
+
+static constexpr char kSynonymsMagic[4] = {'S', 'Y', 'N', '1'};
+
+struct SynonymAlt {
+    std::vector<uint32_t> ids;
+    std::vector<uint32_t> offsets;   // позиции слов фразы относительно первого
+};
+
+using SynonymTable = std::map<uint32_t, std::vector<SynonymAlt>>;
+
+// lookup - id терма в индексе или -1. Варианты с термами, которых нет в
+// индексе, пропускаются: по ним все равно ничего не найдется.
+inline bool compile_synonyms(const std::string& path, const std::function<int64_t(const std::string&)>& lookup,
+                             SynonymTable& table, size_t* groups = nullptr) {
+    std::ifstream in(path);
+    if (!in) return false;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        const size_t hash = line.find('#');
+        if (hash != std::string::npos) line.erase(hash);
+
+        std::vector<SynonymAlt> alts;
+        size_t from = 0;
+        for (;;) {
+            const size_t comma = line.find(',', from);
+            const std::string item = line.substr(from, comma == std::string::npos ? std::string::npos : comma - from);
+            SynonymAlt alt;
+            const std::vector<std::string> words = normalize_query_text(item, &alt.offsets);
+            bool ok = !words.empty();
+            for (const auto& w : words) {
+                const int64_t id = lookup(w);
+                if (id < 0) ok = false;
+                else alt.ids.push_back((uint32_t)id);
+            }
+            if (ok) {
+                const uint32_t base = alt.offsets[0];
+                for (auto& o : alt.offsets) o -= base;
+                if (std::find_if(alts.begin(), alts.end(), [&](const SynonymAlt& a) { return a.ids == alt.ids; }) == alts.end()) {
+                    alts.push_back(std::move(alt));
+                }
+            }
+            if (comma == std::string::npos) break;
+            from = comma + 1;
+        }
+        if (alts.size() < 2) continue;
+        if (groups) (*groups)++;
+        for (size_t i = 0; i < alts.size(); i++) {
+            if (alts[i].ids.size() != 1) continue;
+            auto& out = table[alts[i].ids[0]];
+            for (size_t j = 0; j < alts.size(); j++) {
+                if (j != i) out.push_back(alts[j]);
+            }
+        }
+    }
+    return true;
+}
+
+inline bool write_synonyms(const SynonymTable& table, const std::string& filename) {
+    std::vector<uint32_t> keys, offsets, data;
+    for (const auto& [key, alts] : table) {
+        keys.push_back(key);
+        offsets.push_back((uint32_t)data.size());
+        for (const auto& a : alts) {
+            data.push_back((uint32_t)a.ids.size());
+            data.insert(data.end(), a.ids.begin(), a.ids.end());
+            data.insert(data.end(), a.offsets.begin(), a.offsets.end());
+        }
+    }
+    offsets.push_back((uint32_t)data.size());
+
+    std::ofstream out(filename, std::ios::binary);
+    if (!out) return false;
+    const uint32_t n = (uint32_t)keys.size();
+    out.write(kSynonymsMagic, sizeof(kSynonymsMagic));
+    out.write(reinterpret_cast<const char*>(&n), sizeof(n));
+    out.write(reinterpret_cast<const char*>(keys.data()), keys.size() * sizeof(uint32_t));
+    out.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint32_t));
+    out.write(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(uint32_t));
+    return (bool)out;
+}
+
+class SynonymIndex {
+public:
+    bool open(const std::string& path) {
+        if (!file_.open(path, false) || file_.size() < 8) return false;
+        if (std::memcmp(file_.data(), kSynonymsMagic, sizeof(kSynonymsMagic)) != 0) return false;
+        std::memcpy(&n_, file_.data() + 4, sizeof(n_));
+        if (file_.size() < 8 + (size_t)n_ * 8 + 4) return false;
+        keys_ = reinterpret_cast<const uint32_t*>(file_.data() + 8);
+        offsets_ = keys_ + n_;
+        data_ = offsets_ + n_ + 1;
+        return true;
+    }
+
+    bool is_open() const { return keys_ != nullptr; }
+    uint32_t size() const { return n_; }
+
+    // Варианты для терма term (пусто, если синонимов нет).
+    void lookup(uint32_t term, std::vector<SynonymAlt>& out) const {
+        out.clear();
+        if (!is_open()) return;
+        const uint32_t* it = std::lower_bound(keys_, keys_ + n_, term);
+        if (it == keys_ + n_ || *it != term) return;
+        const uint32_t i = (uint32_t)(it - keys_);
+        for (const uint32_t* p = data_ + offsets_[i]; p < data_ + offsets_[i + 1];) {
+            const uint32_t k = *p++;
+            SynonymAlt alt;
+            alt.ids.assign(p, p + k);
+            alt.offsets.assign(p + k, p + 2 * k);
+            p += 2 * k;
+            out.push_back(std::move(alt));
+        }
+    }
+
+private:
+    MappedFile file_;
+    uint32_t n_ = 0;
+    const uint32_t* keys_ = nullptr;
+    const uint32_t* offsets_ = nullptr;
+    const uint32_t* data_ = nullptr;
+};
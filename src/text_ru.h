@@ -0,0 +1,394 @@
+#pragma once
+
+// Общие правила текста для токенизатора, стеммера и поисковика:
+// классы символов, разбиение на токены и стемминг (Портер для русского).
+// Запросы нормализуются теми же функциями, что и корпус при индексации.
+
+#include <algorithm>
+#include <codecvt>
+#include <cstdint>
+#include <cwctype>
+#include <locale>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+inline bool is_cyrillic(wchar_t c) {
+    return (c >= 0x0400 && c <= 0x04FF) || (c >= 0x0500 && c <= 0x052F) || (c == L'ё' || c == L'Ё');
+}
+
+inline bool is_latin(wchar_t c) {
+    return (c >= L'a' && c <= L'z') || (c >= L'A' && c <= L'Z');
+}
+
+inline bool is_combining_mark(wchar_t c) {
+    return (c >= 0x0300 && c <= 0x036F);
+}
+
+inline bool is_digit(wchar_t c) {
+    return (c >= L'0' && c <= L'9');
+}
+
+inline bool is_alnum_ru(wchar_t c) {
+    return is_digit(c) || is_latin(c) || is_cyrillic(c);
+}
+
+inline wchar_t to_lower_ru(wchar_t c) {
+    return std::towlower(c);
+}
+
+inline std::wstring utf8_to_wstring(std::string_view s) {
+    static std::wstring_convert<std::codecvt_utf8<wchar_t>> conv;
+    return conv.from_bytes(s.data(), s.data() + s.size());
+}
+
+inline std::string wstring_to_utf8(const std::wstring& ws) {
+    static std::wstring_convert<std::codecvt_utf8<wchar_t>> conv;
+    return conv.to_bytes(ws);
+}
+
+inline bool is_all_digits(const std::wstring& s) {
+    if (s.empty()) return false;
+    for (wchar_t c : s) {
+        if (!(c >= L'0' && c <= L'9')) return false;
+    }
+    return true;
+}
+
+inline void tokenize_text(
+    const std::wstring& wtext,
+    std::vector<std::wstring>& tokens,
+    std::vector<uint32_t>& positions
+) {
+    tokens.clear();
+    positions.clear();
+
+    std::wstring cur;
+    cur.reserve(32);
+
+    uint32_t pos = 0;
+
+    auto flush = [&]() {
+        if (cur.empty()) return;
+
+        const bool digits_only = is_all_digits(cur);
+        if (digits_only || cur.size() >= 3) {
+            tokens.push_back(cur);
+            positions.push_back(pos++);
+        }
+        cur.clear();
+    };
+
+    const size_t n = wtext.size();
+    for (size_t i = 0; i < n; i++) {
+        wchar_t c = wtext[i];
+
+        if (is_combining_mark(c)) {
+            continue;
+        }
+
+        if (is_alnum_ru(c)) {
+            cur.push_back(to_lower_ru(c));
+            continue;
+        }
+
+        if (c == L'-') {
+            bool left_ok = !cur.empty();
+            bool right_ok = (i + 1 < n) && is_alnum_ru(wtext[i + 1]);
+            if (left_ok && right_ok) {
+                cur.push_back(L'-');
+                continue;
+            }
+        }
+
+        flush();
+    }
+
+    flush();
+}
+
+inline bool contains_cyrillic(const std::wstring& s) {
+    for (wchar_t c : s) {
+        if (is_cyrillic(c)) return true;
+    }
+    return false;
+}
+
+inline std::wstring to_lower_ws(std::wstring s) {
+    for (auto& ch : s) ch = to_lower_ru(ch);
+    return s;
+}
+
+inline bool is_vowel_ru(wchar_t c) {
+    switch (c) {
+        case L'а': case L'е': case L'и': case L'о': case L'у':
+        case L'ы': case L'э': case L'ю': case L'я': case L'ё':
+            return true;
+        default:
+            return false;
+    }
+}
+
+inline bool ends_with(const std::wstring& s, const std::wstring& suf) {
+    if (s.size() < suf.size()) return false;
+    return std::equal(suf.rbegin(), suf.rend(), s.rbegin());
+}
+
+inline bool remove_suffix_if_ends(std::wstring& s, const std::wstring& suf) {
+    if (!ends_with(s, suf)) return false;
+    s.erase(s.size() - suf.size());
+    return true;
+}
+
+inline bool remove_any_suffix(std::wstring& s, const std::vector<std::wstring>& suffixes) {
+    for (const auto& suf : suffixes) {
+        if (remove_suffix_if_ends(s, suf)) return true;
+    }
+    return false;
+}
+
+inline std::wstring stem_ru_porter(const std::wstring& token) {
+    std::wstring w = to_lower_ws(token);
+
+    for (auto& ch : w) if (ch == L'ё') ch = L'е';
+
+    size_t rv = std::wstring::npos;
+    for (size_t i = 0; i < w.size(); i++) {
+        if (is_vowel_ru(w[i])) {
+            rv = i + 1;
+            break;
+        }
+    }
+    if (rv == std::wstring::npos || rv >= w.size()) {
+        return w;
+    }
+
+    std::wstring prefix = w.substr(0, rv);
+    std::wstring r = w.substr(rv);
+
+    static const std::vector<std::wstring> perfective_1 = {L"ивши", L"ившись", L"ив", L"ившись", L"ивши"};
+    static const std::vector<std::wstring> perfective_2 = {L"вшись", L"вши", L"в"};
+
+    static const std::vector<std::wstring> reflexive = {L"ся", L"сь"};
+
+    static const std::vector<std::wstring> adjective = {
+        L"ее", L"ие", L"ые", L"ое", L"ими", L"ыми", L"ей", L"ий", L"ый", L"ой",
+        L"ем", L"им", L"ым", L"ом", L"его", L"ого", L"ему", L"ому",
+        L"их", L"ых", L"ую", L"юю", L"ая", L"яя", L"ою", L"ею"
+    };
+
+    static const std::vector<std::wstring> participle_1 = {L"ем", L"нн", L"вш", L"ющ", L"щ"};
+    static const std::vector<std::wstring> participle_2 = {L"ивш", L"ывш", L"ующ"};
+
+    static const std::vector<std::wstring> verb_1 = {
+        L"ила", L"ыла", L"ена", L"ейте", L"уйте", L"ите", L"или", L"ыли",
+        L"ей", L"уй", L"ил", L"ыл", L"им", L"ым", L"ен", L"ило", L"ыло",
+        L"ено", L"ят", L"ует", L"уют", L"ит", L"ыт", L"ены", L"ить", L"ыть",
+        L"ишь", L"ую", L"ю"
+    };
+    static const std::vector<std::wstring> verb_2 = {
+        L"ла", L"на", L"ете", L"йте", L"ли", L"й", L"л", L"ем", L"н",
+        L"ло", L"но", L"ет", L"ют", L"ны", L"ть", L"ешь", L"нно"
+    };
+
+    static const std::vector<std::wstring> noun = {
+        L"а", L"ев", L"ов", L"ие", L"ье", L"е", L"иями", L"ями", L"ами",
+        L"еи", L"ии", L"и", L"ией", L"ей", L"ой", L"ий", L"й",
+        L"иям", L"ям", L"ием", L"ем", L"ам", L"ом", L"о",
+        L"у", L"ах", L"иях", L"ях", L"ы", L"ь", L"ию", L"ью",
+        L"ю", L"ия", L"ья", L"я"
+    };
+
+    static const std::vector<std::wstring> derivational = {L"ост", L"ость"};
+
+    static const std::vector<std::wstring> superlative = {L"ейш", L"ейше"};
+
+    bool removed = false;
+
+    if (remove_any_suffix(r, perfective_1)) {
+        removed = true;
+    } else if (remove_any_suffix(r, perfective_2)) {
+        removed = true;
+    }
+
+    if (!removed) {
+        remove_any_suffix(r, reflexive);
+
+        if (remove_any_suffix(r, adjective)) {
+            if (!remove_any_suffix(r, participle_2)) {
+                remove_any_suffix(r, participle_1);
+            }
+        } else {
+            if (!remove_any_suffix(r, verb_1)) {
+                if (!remove_any_suffix(r, verb_2)) {
+                    remove_any_suffix(r, noun);
+                }
+            }
+        }
+    }
+
+    remove_suffix_if_ends(r, L"и");
+
+    if (ends_with(r, L"ость")) {
+        bool has_vowel = false;
+        for (size_t i = 0; i + 4 < r.size(); i++) {
+            if (is_vowel_ru(r[i])) { has_vowel = true; break; }
+        }
+        if (has_vowel) remove_suffix_if_ends(r, L"ость");
+    } else if (ends_with(r, L"ост")) {
+        bool has_vowel = false;
+        for (size_t i = 0; i + 3 < r.size(); i++) {
+            if (is_vowel_ru(r[i])) { has_vowel = true; break; }
+        }
+        if (has_vowel) remove_suffix_if_ends(r, L"ост");
+    }
+
+    if (!remove_suffix_if_ends(r, L"ь")) {
+        remove_any_suffix(r, superlative);
+        if (ends_with(r, L"нн")) {
+            r.erase(r.size() - 1);
+        }
+    }
+
+    return prefix + r;
+}
+
+
+// Числа токена для числового индекса: "1900" -> 1900, "1900-1950" -> 1900, 1950.
+// Числа длиннее 18 цифр не учитываются.
+inline bool parse_numeric_token(const std::wstring& tok, std::vector<uint64_t>& values) {
+    values.clear();
+    uint64_t v = 0;
+    size_t digits = 0;
+    for (size_t i = 0; i <= tok.size(); i++) {
+        if (i == tok.size() || tok[i] == L'-') {
+            if (digits == 0 || digits > 18) {
+                values.clear();
+                return false;
+            }
+            values.push_back(v);
+            v = 0;
+            digits = 0;
+        } else if (is_digit(tok[i])) {
+            v = v * 10 + (uint64_t)(tok[i] - L'0');
+            digits++;
+        } else {
+            values.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+// Части составного слова через дефис ("буровато-серая" -> "буровато", "серая").
+// Части отбираются по тому же правилу, что и токены: число или от 3 символов.
+inline bool compound_parts(const std::wstring& tok, std::vector<std::wstring>& parts) {
+    parts.clear();
+    if (tok.find(L'-') == std::wstring::npos) return false;
+    size_t from = 0;
+    for (;;) {
+        const size_t dash = tok.find(L'-', from);
+        std::wstring part = tok.substr(from, dash == std::wstring::npos ? std::wstring::npos : dash - from);
+        if (is_all_digits(part) || part.size() >= 3) parts.push_back(std::move(part));
+        if (dash == std::wstring::npos) break;
+        from = dash + 1;
+    }
+    return !parts.empty();
+}
+
+// Разделитель слов в терме словосочетания (phrase_dict.h): "homo_sapiens".
+static constexpr wchar_t kPhraseJoiner = L'_';
+
+// Нормализация токена, как в stemmer: числа отбрасываются (пустая строка),
+// короткие и латинские токены только приводятся к нижнему регистру.
+// В терме словосочетания каждое слово нормализуется отдельно.
+inline std::wstring stem_token(const std::wstring& wtok) {
+    if (is_all_digits(wtok)) return std::wstring();
+    const size_t joiner = wtok.find(kPhraseJoiner);
+    if (joiner != std::wstring::npos) {
+        return stem_token(wtok.substr(0, joiner)) + kPhraseJoiner + stem_token(wtok.substr(joiner + 1));
+    }
+    if (wtok.size() <= 3) return to_lower_ws(wtok);
+    if (contains_cyrillic(wtok)) return stem_ru_porter(wtok);
+    return to_lower_ws(wtok);
+}
+
+// Латиница -> кириллица по правилам передачи латинских (биологических)
+// названий: "drosophila" -> "дрозофила", "chlorella" -> "хлорелла".
+// Сочетания букв заменяются раньше одиночных; "c" перед e/i/y - "ц",
+// иначе "к"; "s" между гласными - "з"; начальное "e" - "э", конечное "ia" - "ия".
+inline std::wstring transliterate_latin(const std::wstring& w) {
+    static const std::pair<const wchar_t*, const wchar_t*> kGroups[] = {
+        {L"sch", L"ш"}, {L"sh", L"ш"}, {L"ch", L"х"}, {L"ph", L"ф"}, {L"th", L"т"}, {L"rh", L"р"},
+        {L"ae", L"е"}, {L"oe", L"е"}, {L"qu", L"кв"}, {L"ck", L"к"}, {L"tz", L"ц"}, {L"zh", L"ж"},
+    };
+    static const wchar_t kSingle[] = L"абкдефгхийклмнопкрстуввкиз";
+    auto vowel = [](wchar_t c) { return c == L'a' || c == L'e' || c == L'i' || c == L'o' || c == L'u' || c == L'y'; };
+
+    std::wstring out;
+    out.reserve(w.size());
+    for (size_t i = 0; i < w.size();) {
+        bool group = false;
+        for (const auto& [from, to] : kGroups) {
+            const size_t n = std::char_traits<wchar_t>::length(from);
+            if (w.compare(i, n, from) == 0) {
+                out += to;
+                i += n;
+                group = true;
+                break;
+            }
+        }
+        if (group) continue;
+        if (i + 2 == w.size() && w.compare(i, 2, L"ia") == 0) {
+            out += L"ия";
+            break;
+        }
+        const wchar_t c = w[i];
+        const wchar_t next = i + 1 < w.size() ? w[i + 1] : L'\0';
+        if (c == L'e' && i == 0) out.push_back(L'э');
+        else if (c == L'c') out.push_back(next == L'e' || next == L'i' || next == L'y' ? L'ц' : L'к');
+        else if (c == L's' && i > 0 && vowel(w[i - 1]) && vowel(next)) out.push_back(L'з');
+        else if (c == L'x') out += L"кс";
+        else if (c >= L'a' && c <= L'z') out.push_back(kSingle[c - L'a']);
+        else out.push_back(c);
+        i++;
+    }
+    return out;
+}
+
+// Ключ второго пространства термов (translit_index.h): латинский терм
+// записывается кириллицей и стеммируется, как русское слово, поэтому
+// "drosophila" и "дрозофила" получают один ключ "дрозофил". Для термов
+// не только из латиницы (и коротких) ключа нет - пустая строка.
+inline std::wstring translit_key(const std::wstring& term) {
+    if (term.size() < 4) return std::wstring();
+    for (wchar_t c : term) {
+        if (!(c >= L'a' && c <= L'z')) return std::wstring();
+    }
+    return stem_ru_porter(transliterate_latin(term));
+}
+
+// Слова запроса разбиваются и стеммируются так же, как текст корпуса.
+// positions - позиции оставшихся термов в тексте (для фраз: числа выпадают,
+// но расстояния между словами сохраняются).
+inline std::vector<std::string> normalize_query_text(std::string_view text, std::vector<uint32_t>* out_positions = nullptr) {
+    std::vector<std::string> out;
+    std::wstring wtext;
+    try {
+        wtext = utf8_to_wstring(text);
+    } catch (...) {
+        return out;
+    }
+    std::vector<std::wstring> tokens;
+    std::vector<uint32_t> positions;
+    tokenize_text(wtext, tokens, positions);
+    if (out_positions) out_positions->clear();
+    for (size_t i = 0; i < tokens.size(); i++) {
+        std::wstring st = stem_token(tokens[i]);
+        if (st.empty()) continue;
+        out.push_back(wstring_to_utf8(st));
+        if (out_positions) out_positions->push_back(positions[i]);
+    }
+    return out;
+}
@@ -0,0 +1,360 @@
+#pragma once
+
+// Поток токенов между утилитами (tokenizer -> stemmer -> zipf).
+// Путь "-" означает stdin/stdout, так что утилиты можно соединять пайпом:
+//   export_corpus.py config.yaml - | tokenizer - - | stemmer - - | zipf - data/zipf_stem
+// Поддерживаются два формата:
+//   TSV:      doc_id \t pos \t token \n
+//   бинарный: "TOKB" 0x01, далее кадры документов
+//             varint len, doc_id, varint n, n раз (varint pos, varint len, token)
+// Формат на входе определяется автоматически по сигнатуре.
+// Ввод-вывод идет через собственные буферы по 4 МБ.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+static constexpr size_t kStreamBufferSize = 4u << 20;
+static constexpr char kTokenStreamMagic[5] = {'T', 'O', 'K', 'B', 0x01};
+
+class ByteInput {
+public:
+    ByteInput() : buf_(kStreamBufferSize) {}
+    ByteInput(const ByteInput&) = delete;
+    ByteInput& operator=(const ByteInput&) = delete;
+    ~ByteInput() { close(); }
+
+    bool open(const std::string& path) {
+        close();
+        if (path == "-") {
+            f_ = stdin;
+        } else {
+            f_ = std::fopen(path.c_str(), "rb");
+            owned_ = true;
+        }
+        beg_ = end_ = 0;
+        eof_ = false;
+        return f_ != nullptr;
+    }
+
+    void close() {
+        if (f_ && owned_) std::fclose(f_);
+        f_ = nullptr;
+        owned_ = false;
+    }
+
+    // Гарантирует n доступных байт; false - поток закончился раньше.
+    bool fill(size_t n) {
+        while (end_ - beg_ < n) {
+            if (eof_) return false;
+            if (beg_ > 0) {
+                std::memmove(buf_.data(), buf_.data() + beg_, end_ - beg_);
+                end_ -= beg_;
+                beg_ = 0;
+            }
+            if (buf_.size() - end_ < n) buf_.resize(std::max(buf_.size() * 2, n));
+            size_t got = std::fread(buf_.data() + end_, 1, buf_.size() - end_, f_);
+            if (got == 0) eof_ = true;
+            end_ += got;
+        }
+        return true;
+    }
+
+    std::string_view peek(size_t n) {
+        fill(n);
+        return std::string_view(buf_.data() + beg_, std::min(n, end_ - beg_));
+    }
+
+    void skip(size_t n) { beg_ += n; }
+
+    // Строка без '\n' (и без '\r' в конце); действительна до следующего чтения.
+    bool read_line(std::string_view& line) {
+        size_t scanned = 0;
+        for (;;) {
+            const char* start = buf_.data() + beg_;
+            const void* nl = std::memchr(start + scanned, '\n', end_ - beg_ - scanned);
+            if (nl) {
+                size_t len = (size_t)(static_cast<const char*>(nl) - start);
+                beg_ += len + 1;
+                if (len > 0 && start[len - 1] == '\r') len--;
+                line = std::string_view(start, len);
+                return true;
+            }
+            scanned = end_ - beg_;
+            if (!fill(scanned + 1)) {
+                if (end_ == beg_) return false;
+                const char* rest = buf_.data() + beg_;
+                size_t len = end_ - beg_;
+                beg_ = end_;
+                if (len > 0 && rest[len - 1] == '\r') len--;
+                line = std::string_view(rest, len);
+                return true;
+            }
+        }
+    }
+
+    bool read_varint(uint64_t& v) {
+        v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (!fill(1)) return false;
+            const uint8_t b = (uint8_t)buf_[beg_++];
+            v |= (uint64_t)(b & 0x7F) << shift;
+            if (!(b & 0x80)) return true;
+        }
+        return false;
+    }
+
+    bool read_bytes(size_t n, std::string_view& out) {
+        if (!fill(n)) return false;
+        out = std::string_view(buf_.data() + beg_, n);
+        beg_ += n;
+        return true;
+    }
+
+private:
+    FILE* f_ = nullptr;
+    bool owned_ = false;
+    std::vector<char> buf_;
+    size_t beg_ = 0;
+    size_t end_ = 0;
+    bool eof_ = false;
+};
+
+class ByteOutput {
+public:
+    ByteOutput() { buf_.reserve(kStreamBufferSize); }
+    ByteOutput(const ByteOutput&) = delete;
+    ByteOutput& operator=(const ByteOutput&) = delete;
+    ~ByteOutput() { close(); }
+
+    bool open(const std::string& path) {
+        close();
+        if (path == "-") {
+            f_ = stdout;
+        } else {
+            f_ = std::fopen(path.c_str(), "wb");
+            owned_ = true;
+        }
+        written_ = 0;
+        failed_ = false;
+        return f_ != nullptr;
+    }
+
+    void write(std::string_view s) {
+        if (buf_.size() + s.size() > kStreamBufferSize) flush();
+        if (s.size() > kStreamBufferSize) {
+            raw_write(s.data(), s.size());
+        } else {
+            buf_.append(s.data(), s.size());
+        }
+        written_ += s.size();
+    }
+
+    void put(char c) {
+        if (buf_.size() + 1 > kStreamBufferSize) flush();
+        buf_.push_back(c);
+        written_++;
+    }
+
+    void put_uint(uint64_t v) {
+        char tmp[24];
+        int n = std::snprintf(tmp, sizeof(tmp), "%llu", (unsigned long long)v);
+        write(std::string_view(tmp, (size_t)n));
+    }
+
+    void flush() {
+        if (!buf_.empty()) raw_write(buf_.data(), buf_.size());
+        buf_.clear();
+        if (f_) std::fflush(f_);
+    }
+
+    // false, если была ошибка записи (например, читатель пайпа завершился).
+    bool close() {
+        if (!f_) return !failed_;
+        flush();
+        if (owned_ && std::fclose(f_) != 0) failed_ = true;
+        f_ = nullptr;
+        owned_ = false;
+        return !failed_;
+    }
+
+    uint64_t bytes_written() const { return written_; }
+    bool failed() const { return failed_; }
+
+private:
+    void raw_write(const char* p, size_t n) {
+        if (!f_ || failed_) return;
+        if (std::fwrite(p, 1, n, f_) != n) failed_ = true;
+    }
+
+    FILE* f_ = nullptr;
+    bool owned_ = false;
+    bool failed_ = false;
+    std::string buf_;
+    uint64_t written_ = 0;
+};
+
+inline void append_varint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back((char)((v & 0x7F) | 0x80));
+        v >>= 7;
+    }
+    out.push_back((char)v);
+}
+
+struct TokenRecord {
+    std::string_view doc_id;
+    uint32_t pos = 0;
+    std::string_view token;
+};
+
+class TokenReader {
+public:
+    bool open(const std::string& path) {
+        if (!in_.open(path)) return false;
+        std::string_view head = in_.peek(sizeof(kTokenStreamMagic));
+        binary_ = head.size() == sizeof(kTokenStreamMagic) &&
+                  std::memcmp(head.data(), kTokenStreamMagic, sizeof(kTokenStreamMagic)) == 0;
+        if (binary_) in_.skip(sizeof(kTokenStreamMagic));
+        left_in_frame_ = 0;
+        skipped_ = 0;
+        corrupted_ = false;
+        return true;
+    }
+
+    bool binary() const { return binary_; }
+    uint64_t skipped() const { return skipped_; }
+    bool corrupted() const { return corrupted_; }
+
+    // doc_id и token действительны до следующего вызова.
+    bool next(TokenRecord& rec) {
+        return binary_ ? next_binary(rec) : next_tsv(rec);
+    }
+
+private:
+    bool next_tsv(TokenRecord& rec) {
+        std::string_view line;
+        while (in_.read_line(line)) {
+            if (line.empty()) continue;
+            size_t p1 = line.find('\t');
+            size_t p2 = (p1 == std::string_view::npos) ? p1 : line.find('\t', p1 + 1);
+            if (p2 == std::string_view::npos || p1 == 0 || p2 == p1 + 1 || p2 + 1 == line.size()) {
+                skipped_++;
+                continue;
+            }
+            uint64_t pos = 0;
+            bool ok = true;
+            for (size_t i = p1 + 1; i < p2; i++) {
+                char c = line[i];
+                if (c < '0' || c > '9') { ok = false; break; }
+                pos = pos * 10 + (uint64_t)(c - '0');
+            }
+            if (!ok || pos > UINT32_MAX) {
+                skipped_++;
+                continue;
+            }
+            rec.doc_id = line.substr(0, p1);
+            rec.pos = (uint32_t)pos;
+            rec.token = line.substr(p2 + 1);
+            return true;
+        }
+        return false;
+    }
+
+    bool next_binary(TokenRecord& rec) {
+        uint64_t v = 0;
+        while (left_in_frame_ == 0) {
+            std::string_view id;
+            if (!in_.read_varint(v)) return false;
+            // id указывает в буфер потока: копируется до следующего чтения,
+            // которое может сдвинуть или перевыделить буфер.
+            if (!in_.read_bytes((size_t)v, id)) {
+                corrupted_ = true;
+                return false;
+            }
+            doc_id_.assign(id.data(), id.size());
+            if (!in_.read_varint(left_in_frame_)) {
+                corrupted_ = true;
+                return false;
+            }
+        }
+        std::string_view tok;
+        if (!in_.read_varint(v)) { corrupted_ = true; return false; }
+        rec.pos = (uint32_t)v;
+        if (!in_.read_varint(v) || !in_.read_bytes((size_t)v, tok)) { corrupted_ = true; return false; }
+        left_in_frame_--;
+        rec.doc_id = doc_id_;
+        rec.token = tok;
+        return true;
+    }
+
+    ByteInput in_;
+    bool binary_ = false;
+    bool corrupted_ = false;
+    uint64_t left_in_frame_ = 0;
+    uint64_t skipped_ = 0;
+    std::string doc_id_;
+};
+
+class TokenWriter {
+public:
+    bool open(const std::string& path, bool binary) {
+        if (!out_.open(path)) return false;
+        binary_ = binary;
+        frame_.clear();
+        frame_count_ = 0;
+        if (binary_) out_.write(std::string_view(kTokenStreamMagic, sizeof(kTokenStreamMagic)));
+        return true;
+    }
+
+    bool binary() const { return binary_; }
+
+    void write(std::string_view doc_id, uint32_t pos, std::string_view token) {
+        if (!binary_) {
+            out_.write(doc_id);
+            out_.put('\t');
+            out_.put_uint(pos);
+            out_.put('\t');
+            out_.write(token);
+            out_.put('\n');
+            return;
+        }
+        if (frame_count_ > 0 && doc_id != frame_doc_) end_doc();
+        if (frame_count_ == 0) frame_doc_.assign(doc_id.data(), doc_id.size());
+        append_varint(frame_, pos);
+        append_varint(frame_, token.size());
+        frame_.append(token.data(), token.size());
+        frame_count_++;
+    }
+
+    // Закрывает кадр текущего документа (в бинарном режиме).
+    void end_doc() {
+        if (!binary_ || frame_count_ == 0) return;
+        std::string head;
+        append_varint(head, frame_doc_.size());
+        head += frame_doc_;
+        append_varint(head, frame_count_);
+        out_.write(head);
+        out_.write(frame_);
+        frame_.clear();
+        frame_count_ = 0;
+    }
+
+    uint64_t bytes_written() const { return out_.bytes_written(); }
+
+    bool close() {
+        end_doc();
+        return out_.close();
+    }
+
+private:
+    ByteOutput out_;
+    bool binary_ = false;
+    std::string frame_;
+    std::string frame_doc_;
+    uint64_t frame_count_ = 0;
+};
@@ -2,12 +2,18 @@
 #include <fstream>
 #include <string>
 #include <vector>
+#include <algorithm>
 #include <filesystem>
 #include <chrono>
 #include <clocale>
-#include <cwctype>
-#include <locale>
-#include <codecvt>
+#include <string_view>
+
+#include "bson_reader.h"
+#include "metrics.h"
+#include "minhash.h"
+#include "phrase_dict.h"
+#include "text_ru.h"
+#include "token_stream.h"
 
 namespace fs = std::filesystem;
 
@@ -17,32 +23,8 @@ struct Stats {
     uint64_t total_bytes_text = 0;
 };
 
-static bool is_cyrillic(wchar_t c) {
-    return (c >= 0x0400 && c <= 0x04FF) || (c >= 0x0500 && c <= 0x052F) || (c == L'ё' || c == L'Ё');
-}
-
-static bool is_latin(wchar_t c) {
-    return (c >= L'a' && c <= L'z') || (c >= L'A' && c <= L'Z');
-}
-
-static bool is_combining_mark(wchar_t c) {
-    return (c >= 0x0300 && c <= 0x036F);
-}
-
-static bool is_digit(wchar_t c) {
-    return (c >= L'0' && c <= L'9');
-}
-
-static bool is_alnum_ru(wchar_t c) {
-    return is_digit(c) || is_latin(c) || is_cyrillic(c);
-}
-
-static wchar_t to_lower_ru(wchar_t c) {
-    return std::towlower(c);
-}
-
-static bool extract_doc_id(const std::string& line, std::string& doc_id_out) {
-    const std::string key = "\"doc_id\"";
+static bool extract_doc_id(std::string_view line, std::string& doc_id_out) {
+    const std::string_view key = "\"doc_id\"";
     size_t p = line.find(key);
     if (p == std::string::npos) return false;
     p = line.find(':', p);
@@ -54,19 +36,19 @@ static bool extract_doc_id(const std::string& line, std::string& doc_id_out) {
         p++;
         size_t e = line.find('"', p);
         if (e == std::string::npos) return false;
-        doc_id_out = line.substr(p, e - p);
+        doc_id_out = std::string(line.substr(p, e - p));
         return true;
     }
 
     size_t e = p;
     while (e < line.size() && (line[e] >= '0' && line[e] <= '9')) e++;
     if (e == p) return false;
-    doc_id_out = line.substr(p, e - p);
+    doc_id_out = std::string(line.substr(p, e - p));
     return true;
 }
 
-static bool extract_clean_text(const std::string& line, std::string& text_out) {
-    const std::string key = "\"clean_text\"";
+static bool extract_clean_text(std::string_view line, std::string& text_out) {
+    const std::string_view key = "\"clean_text\"";
     size_t p = line.find(key);
     if (p == std::string::npos) return false;
     p = line.find(':', p);
@@ -104,76 +86,6 @@ static bool extract_clean_text(const std::string& line, std::string& text_out) {
     return false;
 }
 
-static std::wstring utf8_to_wstring(const std::string& s) {
-    static std::wstring_convert<std::codecvt_utf8<wchar_t>> conv;
-    return conv.from_bytes(s);
-}
-
-static std::string wstring_to_utf8(const std::wstring& ws) {
-    static std::wstring_convert<std::codecvt_utf8<wchar_t>> conv;
-    return conv.to_bytes(ws);
-}
-
-static bool is_all_digits(const std::wstring& s) {
-    if (s.empty()) return false;
-    for (wchar_t c : s) {
-        if (!(c >= L'0' && c <= L'9')) return false;
-    }
-    return true;
-}
-
-static void tokenize_text(
-    const std::wstring& wtext,
-    std::vector<std::wstring>& tokens,
-    std::vector<uint32_t>& positions
-) {
-    tokens.clear();
-    positions.clear();
-
-    std::wstring cur;
-    cur.reserve(32);
-
-    uint32_t pos = 0;
-
-    auto flush = [&]() {
-        if (cur.empty()) return;
-
-        const bool digits_only = is_all_digits(cur);
-        if (digits_only || cur.size() >= 3) {
-            tokens.push_back(cur);
-            positions.push_back(pos++);
-        }
-        cur.clear();
-    };
-
-    const size_t n = wtext.size();
-    for (size_t i = 0; i < n; i++) {
-        wchar_t c = wtext[i];
-
-        if (is_combining_mark(c)) {
-            continue;
-        }
-
-        if (is_alnum_ru(c)) {
-            cur.push_back(to_lower_ru(c));
-            continue;
-        }
-
-        if (c == L'-') {
-            bool left_ok = !cur.empty();
-            bool right_ok = (i + 1 < n) && is_alnum_ru(wtext[i + 1]);
-            if (left_ok && right_ok) {
-                cur.push_back(L'-');
-                continue;
-            }
-        }
-
-        flush();
-    }
-
-    flush();
-}
-
 static void ensure_dir(const fs::path& p) {
     std::error_code ec;
     if (!fs::exists(p, ec)) {
@@ -184,52 +96,120 @@ static void ensure_dir(const fs::path& p) {
 int main(int argc, char** argv) {
     std::setlocale(LC_ALL, "C.UTF-8");
 
-    if (argc < 3) {
-        std::cerr << "Использование: tokenizer <input.jsonl> <output_dir>\n";
+    bool binary = false;
+    bool split_compounds = true;
+    std::string minhash_path;
+    std::string numbers_path;
+    std::string phrases_path = fs::exists("phrases.txt") ? "phrases.txt" : "";
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++) {
+        const std::string a = argv[i];
+        if (a == "--binary") binary = true;
+        else if (a == "--no-compound-parts") split_compounds = false;
+        else if (a == "--minhash" && i + 1 < argc) minhash_path = argv[++i];
+        else if (a == "--numbers" && i + 1 < argc) numbers_path = argv[++i];
+        else if (a == "--phrases" && i + 1 < argc) phrases_path = argv[++i];
+        else args.push_back(a);
+    }
+
+    if (args.size() < 2) {
+        std::cerr << "Использование: tokenizer [--binary] <input.jsonl|dump.bson|-> <output_dir|->\n";
         std::cerr << "Пример: tokenizer data/corpus.jsonl data/tokens\n";
+        std::cerr << "Пример: tokenizer data/dump/search_engine/documents.bson data/tokens\n";
+        std::cerr << "Пример: python src/export_corpus.py config.yaml - | tokenizer - - | stemmer - - | zipf - data/zipf_stem\n";
+        std::cerr << "  -          stdin (JSONL) / stdout (поток токенов, docs.idx не пишется)\n";
+        std::cerr << "  --binary   кадрированный бинарный поток токенов вместо TSV\n";
+        std::cerr << "  --no-compound-parts  не выдавать части слов через дефис\n";
+        std::cerr << "  --minhash <path>  куда писать MinHash-сигнатуры (по умолчанию <output_dir>/minhash.bin)\n";
+        std::cerr << "  --numbers <path>  куда писать числа для числового индекса (по умолчанию <output_dir>/numbers.tsv)\n";
+        std::cerr << "  --phrases <path>  словарь словосочетаний (по умолчанию phrases.txt, если есть; \"\" - без словаря)\n";
         return 1;
     }
 
-    const fs::path input_path = argv[1];
-    const fs::path out_dir = argv[2];
+    const fs::path input_path = args[0];
+    const fs::path out_dir = args[1];
+    const bool to_stdout = (args[1] == "-");
 
-    ensure_dir(out_dir);
+    // Когда токены идут в stdout, сводка печатается в stderr.
+    std::ostream& log = to_stdout ? std::cerr : std::cout;
 
-    std::ifstream in(input_path);
-    if (!in) {
+    // Дамп mongodump читается напрямую, без экспорта в JSONL.
+    const bool bson_input = is_bson_path(input_path.string());
+    BsonDumpReader bson;
+    ByteInput in;
+    const bool opened = bson_input ? bson.open(input_path.string()) : in.open(input_path.string());
+    if (!opened) {
         std::cerr << "Не удалось открыть входной файл: " << input_path << "\n";
         return 1;
     }
 
-    std::ofstream tokens_out(out_dir / "tokens.tsv", std::ios::binary);
-    if (!tokens_out) {
-        std::cerr << "Не удалось открыть tokens.tsv\n";
+    const fs::path tokens_path = to_stdout ? fs::path("-") : out_dir / (binary ? "tokens.bin" : "tokens.tsv");
+    if (!to_stdout) ensure_dir(out_dir);
+
+    TokenWriter tokens_out;
+    if (!tokens_out.open(tokens_path.string(), binary)) {
+        std::cerr << "Не удалось открыть " << tokens_path << "\n";
+        return 1;
+    }
+
+    std::ofstream docs_idx;
+    if (!to_stdout) {
+        docs_idx.open(out_dir / "docs.idx", std::ios::binary);
+        if (!docs_idx) {
+            std::cerr << "Не удалось открыть docs.idx\n";
+            return 1;
+        }
+    }
+
+    // Сигнатуры для поиска почти-дубликатов в индексаторе.
+    if (minhash_path.empty() && !to_stdout) minhash_path = (out_dir / "minhash.bin").string();
+    MinHashWriter minhash_out;
+    if (!minhash_path.empty() && !minhash_out.open(minhash_path)) {
+        std::cerr << "Не удалось открыть " << minhash_path << "\n";
+        return 1;
+    }
+
+    // Числа из текста (годы, даты) для запросов range:[a TO b].
+    if (numbers_path.empty() && !to_stdout) numbers_path = (out_dir / "numbers.tsv").string();
+    TokenWriter numbers_out;
+    if (!numbers_path.empty() && !numbers_out.open(numbers_path, false)) {
+        std::cerr << "Не удалось открыть " << numbers_path << "\n";
         return 1;
     }
 
-    std::ofstream docs_idx(out_dir / "docs.idx", std::ios::binary);
-    if (!docs_idx) {
-        std::cerr << "Не удалось открыть docs.idx\n";
+    // Словосочетания выдаются отдельными термами (phrase_dict.h).
+    PhraseDict phrases;
+    if (!phrases_path.empty() && !phrases.load(phrases_path)) {
+        std::cerr << "Не удалось открыть словарь словосочетаний " << phrases_path << "\n";
         return 1;
     }
 
     Stats stats;
     auto t0 = std::chrono::steady_clock::now();
 
-    std::string line;
+    metrics::Registry reg("tokenizer");
+    auto& m_docs = reg.counter("docs_total", "Обработано документов");
+    auto& m_tokens = reg.counter("tokens_total", "Выдано токенов");
+    auto& m_bytes = reg.counter("input_bytes_total", "Байт clean_text на входе");
+    auto& m_skipped = reg.counter("skipped_lines_total", "Пропущено строк без doc_id/clean_text или с битым UTF-8");
+    auto& m_numbers = reg.counter("numbers_total", "Чисел выписано в числовой индекс");
+    auto& m_parts = reg.counter("compound_parts_total", "Частей составных слов, выданных на позиции слова");
+    auto& m_phrases = reg.counter("phrases_total", "Словосочетаний из словаря, выданных термами");
+    auto& m_doc_us = reg.histogram("doc_tokenize_us", "Время токенизации одного документа, мкс");
+
+    std::string_view line;
     uint64_t docs = 0;
 
     std::vector<std::wstring> tokens;
     std::vector<uint32_t> positions;
+    std::vector<uint64_t> token_hashes;
+    std::vector<uint32_t> signature;
+    std::vector<uint64_t> numbers;
+    std::vector<std::wstring> parts;
+    std::vector<PhraseDict::Match> matches;
 
-    while (std::getline(in, line)) {
-        if (line.empty()) continue;
-
-        std::string doc_id;
-        std::string clean_text;
-
-        if (!extract_doc_id(line, doc_id)) continue;
-        if (!extract_clean_text(line, clean_text)) continue;
+    auto process_doc = [&](std::string_view doc_id, std::string_view clean_text) {
+        metrics::Timer doc_timer;
 
         stats.total_bytes_text += (uint64_t)clean_text.size();
 
@@ -237,27 +217,97 @@ int main(int argc, char** argv) {
         try {
             wtext = utf8_to_wstring(clean_text);
         } catch (...) {
-            continue;
+            m_skipped.inc();
+            return;
         }
 
         tokenize_text(wtext, tokens, positions);
+        phrases.match(tokens, matches);
+        std::sort(matches.begin(), matches.end(), [](const PhraseDict::Match& a, const PhraseDict::Match& b) {
+            return a.start < b.start;
+        });
+        size_t next_match = 0;
 
-        std::streampos start_offset = tokens_out.tellp();
+        const uint64_t start_offset = tokens_out.bytes_written();
         uint64_t doc_token_count = 0;
 
         for (size_t i = 0; i < tokens.size(); i++) {
             const std::string tok_utf8 = wstring_to_utf8(tokens[i]);
 
-            tokens_out << doc_id << "\t" << positions[i] << "\t" << tok_utf8 << "\n";
+            tokens_out.write(doc_id, positions[i], tok_utf8);
+
+            // Составное слово и его части занимают одну позицию, поэтому
+            // "серая" находит "буровато-серая", а фразы не сдвигаются.
+            if (split_compounds && compound_parts(tokens[i], parts)) {
+                for (const auto& part : parts) tokens_out.write(doc_id, positions[i], wstring_to_utf8(part));
+                m_parts.inc(parts.size());
+            }
+
+            // Терм словосочетания - на позиции его первого слова, чтобы
+            // позиции документа в потоке не убывали.
+            for (; next_match < matches.size() && matches[next_match].start == i; next_match++) {
+                tokens_out.write(doc_id, positions[i], wstring_to_utf8(phrases.text(matches[next_match].phrase)));
+                m_phrases.inc();
+            }
+
+            if (!numbers_path.empty() && is_digit(tokens[i][0]) && parse_numeric_token(tokens[i], numbers)) {
+                for (uint64_t v : numbers) numbers_out.write(doc_id, positions[i], std::to_string(v));
+                m_numbers.inc(numbers.size());
+            }
 
             stats.total_tokens++;
             stats.total_token_chars += (uint64_t)tokens[i].size();
             doc_token_count++;
         }
 
-        docs_idx << doc_id << "\t" << (uint64_t)start_offset << "\t" << doc_token_count << "\n";
+        tokens_out.end_doc();
+
+        if (minhash_out.is_open()) {
+            token_hashes.clear();
+            for (const auto& t : tokens) token_hashes.push_back(hash_token(t));
+            compute_minhash(token_hashes, signature);
+            minhash_out.write(doc_id, (uint32_t)doc_token_count, signature);
+        }
+
+        if (docs_idx.is_open()) {
+            docs_idx << doc_id << "\t" << start_offset << "\t" << doc_token_count << "\n";
+        }
 
         docs++;
+        m_docs.inc();
+        m_tokens.inc(doc_token_count);
+        m_bytes.inc(clean_text.size());
+        m_doc_us.record(doc_timer.us());
+    };
+
+    if (bson_input) {
+        BsonCorpusDoc doc;
+        while (bson.next(doc)) {
+            process_doc(doc.doc_id(), doc.clean_text);
+        }
+        m_skipped.inc(bson.docs_skipped());
+        if (bson.corrupted()) {
+            std::cerr << "Дамп поврежден после " << bson.bytes_read() << " байт, остаток пропущен\n";
+        }
+    } else {
+        while (in.read_line(line)) {
+            if (line.empty()) continue;
+
+            std::string doc_id;
+            std::string clean_text;
+
+            if (!extract_doc_id(line, doc_id) || !extract_clean_text(line, clean_text)) {
+                m_skipped.inc();
+                continue;
+            }
+
+            process_doc(doc_id, clean_text);
+        }
+    }
+
+    if (!tokens_out.close() || !numbers_out.close()) {
+        std::cerr << "Ошибка записи потока токенов\n";
+        return 1;
     }
 
     auto t1 = std::chrono::steady_clock::now();
@@ -269,16 +319,35 @@ int main(int argc, char** argv) {
     double us_per_kb = (kb > 0.0) ? (sec * 1e6 / kb) : 0.0;
     double tok_per_sec = (sec > 0.0) ? ((double)stats.total_tokens / sec) : 0.0;
 
-    std::cout << "Обработано документов: " << docs << "\n";
-    std::cout << "Общее количество токенов: " << stats.total_tokens << "\n";
-    std::cout << "Средняя длина токена (символов): " << avg_len << "\n";
-    std::cout << "Размер входных данных (clean_text): " << stats.total_bytes_text << " (" << kb << " KB)\n";
-    std::cout << "Время: " << sec << " сек\n";
-    std::cout << "Скорость: " << kb_per_sec << " KB/с\n";
-    std::cout << "Скорость: " << us_per_kb << " мк/KB\n";
-    std::cout << "Скорость: " << tok_per_sec << " токенов/с\n";
-    std::cout << "Токены сохранены в: " << (out_dir / "tokens.tsv") << "\n";
-    std::cout << "Индекс документов сохранен в: " << (out_dir / "docs.idx") << "\n";
+    reg.gauge("elapsed_seconds", "Общее время работы, с").set(sec);
+    reg.gauge("avg_token_chars", "Средняя длина токена, символов").set(avg_len);
+    reg.gauge("kb_per_second", "Пропускная способность, KB/с").set(kb_per_sec);
+    reg.gauge("tokens_per_second", "Пропускная способность, токенов/с").set(tok_per_sec);
+    if (!metrics::dump_json(reg)) {
+        std::cerr << "Не удалось записать метрики в " << metrics::metrics_dir() << "\n";
+    }
+
+    log << "Обработано документов: " << docs << "\n";
+    log << "Общее количество токенов: " << stats.total_tokens << "\n";
+    log << "Средняя длина токена (символов): " << avg_len << "\n";
+    log << "Размер входных данных (clean_text): " << stats.total_bytes_text << " (" << kb << " KB)\n";
+    log << "Время: " << sec << " сек\n";
+    log << "Скорость: " << kb_per_sec << " KB/с\n";
+    log << "Скорость: " << us_per_kb << " мк/KB\n";
+    log << "Скорость: " << tok_per_sec << " токенов/с\n";
+    if (!to_stdout) {
+        log << "Токены сохранены в: " << tokens_path << "\n";
+        log << "Индекс документов сохранен в: " << (out_dir / "docs.idx") << "\n";
+    }
+    if (phrases.size() > 0) {
+        log << "Словосочетаний в словаре: " << phrases.size() << ", найдено в тексте: " << m_phrases.value() << "\n";
+    }
+    if (!numbers_path.empty()) {
+        log << "Числа сохранены в: " << numbers_path << " (" << m_numbers.value() << ")\n";
+    }
+    if (minhash_out.is_open()) {
+        log << "MinHash-сигнатуры сохранены в: " << minhash_path << "\n";
+    }
 
     return 0;
 }
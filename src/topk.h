@@ -0,0 +1,209 @@
+#pragma once
+
+// Ранжирование BM25 и отбор top-k.
+// wand_run/wand_topk - дизъюнктивный запрос по алгоритму WAND: курсоры термов
+// упорядочены по текущему документу, опорный (pivot) документ - первый, на
+// котором сумма верхних границ (weight * max_score) превышает порог кучи;
+// документы левее опорного пропускаются через next_geq без подсчета оценки.
+// score_docs - оценка уже отобранных документов (булев фильтр + BM25).
+// С StaticPrior к оценке прибавляется weight * статический ранг документа
+// (static_rank.h). Ранг не возрастает с номером документа, поэтому обход
+// прекращается, когда сумма верхних границ BM25 и ранга текущего документа
+// не превышает порога кучи: дальше кандидаты только хуже.
+
+#include <algorithm>
+#include <cstdint>
+#include <queue>
+#include <vector>
+
+#include "index_format.h"
+
+struct ScoredDoc {
+    uint32_t doc;
+    float score;
+};
+
+struct WeightedTerm {
+    uint32_t term;
+    float weight;
+};
+
+struct TopKStats {
+    uint64_t scored = 0;   // документов, для которых посчитана полная оценка
+    uint64_t skipped = 0;  // вызовов next_geq, перепрыгнувших документы
+    uint64_t early_stops = 0;  // обходов, остановленных по статическому рангу
+};
+
+struct StaticPrior {
+    const float* rank = nullptr;  // IndexReader::static_rank()
+    float weight = 0.0f;
+
+    bool enabled() const { return rank != nullptr && weight > 0.0f; }
+    float at(uint32_t doc) const { return enabled() ? weight * rank[doc] : 0.0f; }
+};
+
+class TopKHeap {
+public:
+    explicit TopKHeap(size_t k) : k_(k) {}
+
+    // Порог, который документ должен превысить, чтобы попасть в кучу.
+    float threshold() const { return heap_.size() < k_ ? 0.0f : heap_.top().score; }
+    bool full() const { return heap_.size() >= k_; }
+
+    void push(uint32_t doc, float score) {
+        if (k_ == 0) return;
+        if (heap_.size() < k_) {
+            heap_.push({doc, score});
+        } else if (score > heap_.top().score) {
+            heap_.pop();
+            heap_.push({doc, score});
+        }
+    }
+
+    // По убыванию оценки, при равенстве - по номеру документа.
+    std::vector<ScoredDoc> take() {
+        std::vector<ScoredDoc> out;
+        out.reserve(heap_.size());
+        while (!heap_.empty()) {
+            out.push_back(heap_.top());
+            heap_.pop();
+        }
+        std::sort(out.begin(), out.end(), [](const ScoredDoc& a, const ScoredDoc& b) {
+            return a.score != b.score ? a.score > b.score : a.doc < b.doc;
+        });
+        return out;
+    }
+
+private:
+    struct Worse {
+        bool operator()(const ScoredDoc& a, const ScoredDoc& b) const {
+            return a.score != b.score ? a.score > b.score : a.doc < b.doc;
+        }
+    };
+
+    size_t k_;
+    std::priority_queue<ScoredDoc, std::vector<ScoredDoc>, Worse> heap_;
+};
+
+// Курсор WAND поверх любого итератора с интерфейсом PostingIterator
+// (doc, tf, next, next_geq, at_end).
+template <typename It>
+struct WandCursor {
+    It it;
+    float weight;  // вес терма в запросе * idf
+    float ub;      // верхняя граница вклада терма
+};
+
+template <typename It>
+inline std::vector<ScoredDoc> wand_run(const IndexReader& idx, std::vector<WandCursor<It>>& cursors, size_t k,
+                                       uint32_t exclude = kEndDoc, TopKStats* stats = nullptr,
+                                       const StaticPrior& prior = StaticPrior()) {
+    TopKHeap heap(k);
+    for (;;) {
+        std::sort(cursors.begin(), cursors.end(), [](const WandCursor<It>& a, const WandCursor<It>& b) {
+            return a.it.doc() < b.it.doc();
+        });
+
+        // Документ левее cursors[i + 1] содержит только термы 0..i и не
+        // раньше cursors[i], так что его ранг не больше ранга cursors[i].
+        const float threshold = heap.threshold();
+        float acc = 0.0f;
+        size_t pivot = cursors.size();
+        for (size_t i = 0; i < cursors.size() && !cursors[i].it.at_end(); i++) {
+            acc += cursors[i].ub;
+            if (acc + prior.at(cursors[i].it.doc()) > threshold) {
+                pivot = i;
+                break;
+            }
+        }
+        if (pivot == cursors.size()) {
+            if (stats && prior.enabled() && !cursors.empty() && !cursors[0].it.at_end()) stats->early_stops++;
+            break;
+        }
+
+        const uint32_t pdoc = cursors[pivot].it.doc();
+        if (cursors[0].it.doc() == pdoc) {
+            float score = prior.at(pdoc);
+            const float norm = idx.doc_norm(pdoc);
+            for (auto& c : cursors) {
+                if (c.it.doc() != pdoc) break;
+                score += c.weight * idx.posting_score(c.it, norm);
+                c.it.next();
+            }
+            if (pdoc != exclude) heap.push(pdoc, score);
+            if (stats) stats->scored++;
+        } else {
+            for (size_t i = 0; i < pivot; i++) {
+                if (cursors[i].it.doc() < pdoc) {
+                    cursors[i].it.next_geq(pdoc);
+                    if (stats) stats->skipped++;
+                }
+            }
+        }
+    }
+    return heap.take();
+}
+
+inline std::vector<ScoredDoc> wand_topk(const IndexReader& idx, const std::vector<WeightedTerm>& terms, size_t k,
+                                        uint32_t exclude = kEndDoc, TopKStats* stats = nullptr,
+                                        const StaticPrior& prior = StaticPrior()) {
+    std::vector<WandCursor<PostingIterator>> cursors;
+    cursors.reserve(terms.size());
+    for (const auto& t : terms) {
+        if (t.weight <= 0.0f) continue;
+        cursors.push_back({idx.postings(t.term), t.weight * idx.posting_weight(t.term), t.weight * idx.term(t.term).max_score});
+    }
+    return wand_run(idx, cursors, k, exclude, stats, prior);
+}
+
+// BM25 для заранее отобранных документов (docs отсортированы по возрастанию).
+inline std::vector<ScoredDoc> score_docs(const IndexReader& idx, const std::vector<WeightedTerm>& terms,
+                                         const std::vector<uint32_t>& docs, size_t k, TopKStats* stats = nullptr,
+                                         const StaticPrior& prior = StaticPrior()) {
+    std::vector<PostingIterator> its;
+    std::vector<float> weights;
+    float ub = 0.0f;
+    for (const auto& t : terms) {
+        its.push_back(idx.postings(t.term));
+        weights.push_back(t.weight * idx.posting_weight(t.term));
+        ub += std::max(t.weight, 0.0f) * idx.term(t.term).max_score;
+    }
+
+    TopKHeap heap(k);
+    for (uint32_t d : docs) {
+        if (prior.enabled() && heap.full() && ub + prior.at(d) <= heap.threshold()) {
+            if (stats) stats->early_stops++;
+            break;
+        }
+        float score = prior.at(d);
+        const float norm = idx.doc_norm(d);
+        for (size_t i = 0; i < its.size(); i++) {
+            its[i].next_geq(d);
+            if (its[i].doc() == d) score += weights[i] * idx.posting_score(its[i], norm);
+        }
+        heap.push(d, score);
+        if (stats) stats->scored++;
+    }
+    return heap.take();
+}
+
+// Термы для поиска похожих: top-n термов вектора документа по tf * idf.
+// Термы, встречающиеся только в самом документе, ничего не найдут и отбрасываются.
+inline std::vector<WeightedTerm> more_like_this_terms(const IndexReader& idx, uint32_t doc, size_t n) {
+    std::vector<std::pair<uint32_t, uint32_t>> vec;
+    idx.forward(doc, vec);
+    std::vector<WeightedTerm> terms;
+    for (const auto& [term, tf] : vec) {
+        if (idx.term(term).df < 2) continue;
+        terms.push_back({term, (float)tf * idx.idf(term)});
+    }
+    std::sort(terms.begin(), terms.end(), [](const WeightedTerm& a, const WeightedTerm& b) {
+        return a.weight != b.weight ? a.weight > b.weight : a.term < b.term;
+    });
+    if (terms.size() > n) terms.resize(n);
+    if (!terms.empty()) {
+        const float top = terms[0].weight;
+        for (auto& t : terms) t.weight /= top;
+    }
+    return terms;
+}
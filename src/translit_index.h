@@ -0,0 +1,86 @@
+#pragma once
+
+// Второе пространство ключей словаря: латинские термы по ключу транслитерации
+// (translit_key в text_ru.h). Индексатор пишет data/translit_index.bin:
+//   "TRL1", uint32 n,
+//   n x uint32 id латинского терма в основном словаре,
+//   (n + 1) x uint32 смещений ключей, байты ключей (UTF-8).
+// Записи отсортированы по ключу, поиск - двоичный, как в основном словаре.
+// Запрос "дрозофила" (стем "дрозоф") находит здесь терм "drosophila", а
+// "drosophila" - кириллический терм по своему ключу в основном словаре.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "mmap_file.h"
+
+static constexpr char kTranslitMagic[4] = {'T', 'R', 'L', '1'};
+
+// entries - пары (ключ, id терма); портится (сортируется).
+inline bool write_translit_index(std::vector<std::pair<std::string, uint32_t>>& entries, const std::string& filename) {
+    std::sort(entries.begin(), entries.end());
+    std::vector<uint32_t> ids, offsets;
+    std::string keys;
+    for (const auto& [key, id] : entries) {
+        ids.push_back(id);
+        offsets.push_back((uint32_t)keys.size());
+        keys += key;
+    }
+    offsets.push_back((uint32_t)keys.size());
+
+    std::ofstream out(filename, std::ios::binary);
+    if (!out) return false;
+    const uint32_t n = (uint32_t)ids.size();
+    out.write(kTranslitMagic, sizeof(kTranslitMagic));
+    out.write(reinterpret_cast<const char*>(&n), sizeof(n));
+    out.write(reinterpret_cast<const char*>(ids.data()), ids.size() * sizeof(uint32_t));
+    out.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint32_t));
+    out.write(keys.data(), keys.size());
+    return (bool)out;
+}
+
+class TranslitIndex {
+public:
+    bool open(const std::string& path) {
+        if (!file_.open(path, false) || file_.size() < 8) return false;
+        if (std::memcmp(file_.data(), kTranslitMagic, sizeof(kTranslitMagic)) != 0) return false;
+        std::memcpy(&n_, file_.data() + 4, sizeof(n_));
+        if (file_.size() < 8 + (size_t)n_ * 8 + 4) return false;
+        ids_ = reinterpret_cast<const uint32_t*>(file_.data() + 8);
+        offsets_ = ids_ + n_;
+        keys_ = reinterpret_cast<const char*>(offsets_ + n_ + 1);
+        return true;
+    }
+
+    bool is_open() const { return ids_ != nullptr; }
+    uint32_t size() const { return n_; }
+
+    // Дописывает в out id всех термов с ключом key.
+    void lookup(std::string_view key, std::vector<uint32_t>& out) const {
+        if (!is_open()) return;
+        uint32_t lo = 0, hi = n_;
+        while (lo < hi) {
+            const uint32_t mid = lo + (hi - lo) / 2;
+            if (key_at(mid) < key) lo = mid + 1;
+            else hi = mid;
+        }
+        for (; lo < n_ && key_at(lo) == key; lo++) out.push_back(ids_[lo]);
+    }
+
+private:
+    std::string_view key_at(uint32_t i) const {
+        return std::string_view(keys_ + offsets_[i], offsets_[i + 1] - offsets_[i]);
+    }
+
+    MappedFile file_;
+    uint32_t n_ = 0;
+    const uint32_t* ids_ = nullptr;
+    const uint32_t* offsets_ = nullptr;
+    const char* keys_ = nullptr;
+};
@@ -7,6 +7,10 @@
 #include <cstdint>
 #include <filesystem>
 #include <cstdlib>
+#include <unordered_map>
+
+#include "metrics.h"
+#include "token_stream.h"
 
 namespace fs = std::filesystem;
 
@@ -15,16 +19,11 @@ struct TermFreq {
     uint32_t freq;
 };
 
-static bool parse_token_from_tokens_tsv_line(const std::string& line, std::string& token_out) {
-    size_t p1 = line.find('\t');
-    if (p1 == std::string::npos) return false;
-    size_t p2 = line.find('\t', p1 + 1);
-    if (p2 == std::string::npos) return false;
-
-    token_out = line.substr(p2 + 1);
-    if (!token_out.empty() && token_out.back() == '\r') token_out.pop_back();
-    return !token_out.empty();
-}
+struct PhraseCandidate {
+    std::string phrase;
+    uint32_t freq;
+    double pmi;
+};
 
 static void ensure_dir(const fs::path& p) {
     std::error_code ec;
@@ -42,9 +41,24 @@ int main(int argc, char** argv) {
 
     int topN = 50;
 
-    if (argc >= 2) tokens_path = argv[1];
-    if (argc >= 3) out_dir = argv[2];
-    if (argc >= 4) topN = std::atoi(argv[3]);
+    // Кандидаты в словарь словосочетаний (phrase_dict.h): пары соседних
+    // токенов с наибольшей PMI = log2(n(ab) * N / (n(a) * n(b))). Считать по
+    // tokens.tsv до стемминга: словарь сопоставляется с токенами текста.
+    std::string phrases_out;
+    size_t phrases_top = 100;
+    uint32_t phrases_min_count = 5;
+
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++) {
+        const std::string a = argv[i];
+        if (a == "--phrases-out" && i + 1 < argc) phrases_out = argv[++i];
+        else if (a == "--phrases-top" && i + 1 < argc) phrases_top = std::strtoul(argv[++i], nullptr, 10);
+        else if (a == "--phrases-min-count" && i + 1 < argc) phrases_min_count = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+        else args.push_back(a);
+    }
+    if (args.size() >= 1) tokens_path = args[0];
+    if (args.size() >= 2) out_dir = args[1];
+    if (args.size() >= 3) topN = std::atoi(args[2].c_str());
 
     std::cout << "Tokens file: " << tokens_path << "\n";
     std::cout << "Output dir : " << out_dir << "\n";
@@ -52,66 +66,114 @@ int main(int argc, char** argv) {
 
     ensure_dir(out_dir);
 
-    std::ifstream in(tokens_path, std::ios::binary);
-    if (!in) {
+    metrics::Registry reg("zipf");
+    metrics::Timer run_timer;
+    metrics::Timer phase_timer;
+
+    // "-" - поток токенов со stdin (TSV или бинарный, определяется по сигнатуре).
+    TokenReader in;
+    if (!in.open(tokens_path.string())) {
         std::cerr << "ERROR: Cannot open tokens file: " << tokens_path << "\n";
         std::cerr << "Hint: run tokenizer first to generate data/tokens/tokens.tsv\n";
         return 1;
     }
 
-    std::vector<std::string> terms;
-    terms.reserve(1'000'000);
+    // Частоты считаются на лету, чтобы в пайпе не держать в памяти весь поток токенов.
+    std::unordered_map<std::string, uint32_t> counts;
+    counts.reserve(1 << 20);
 
+    uint64_t records = 0;
     uint64_t bytes_read = 0;
-    uint64_t lines = 0;
-
-    std::string line;
-    std::string tok;
 
-    while (std::getline(in, line)) {
-        bytes_read += line.size() + 1;
-        lines++;
-
-        if (!parse_token_from_tokens_tsv_line(line, tok)) continue;
-        terms.push_back(tok);
+    TokenRecord rec;
+    std::string key;
+
+    // Пары считаются только по первому токену каждой позиции: части
+    // составных слов и термы словосочетаний стоят на позиции слова.
+    std::unordered_map<std::string, uint32_t> pairs;
+    std::string prev_doc, prev_token, pair;
+    uint32_t prev_pos = 0;
+    uint64_t pairs_total = 0;
+
+    while (in.next(rec)) {
+        records++;
+        bytes_read += rec.doc_id.size() + rec.token.size() + 2;
+        key.assign(rec.token.data(), rec.token.size());
+        counts[key]++;
+
+        if (phrases_out.empty()) continue;
+        const bool same_doc = rec.doc_id == prev_doc;
+        if (same_doc && rec.pos == prev_pos) continue;
+        const bool word = !key.empty() && !(key[0] >= '0' && key[0] <= '9') && key.find('_') == std::string::npos;
+        if (same_doc && rec.pos == prev_pos + 1 && word && !prev_token.empty()) {
+            pair.assign(prev_token).append(" ").append(key);
+            pairs[pair]++;
+            pairs_total++;
+        }
+        if (!same_doc) prev_doc.assign(rec.doc_id.data(), rec.doc_id.size());
+        prev_pos = rec.pos;
+        if (word) prev_token = key;
+        else prev_token.clear();
     }
-    in.close();
+    reg.gauge("read_seconds", "Время чтения и подсчета токенов, с").set(phase_timer.seconds());
+    reg.counter("lines_total", "Прочитано записей").inc(records + in.skipped());
+    reg.counter("input_bytes_total", "Прочитано байт (doc_id и токены)").inc(bytes_read);
+    reg.counter("tokens_total", "Токенов").inc(records);
 
-    if (terms.empty()) {
-        std::cerr << "ERROR: No terms found in tokens.tsv\n";
+    if (counts.empty()) {
+        std::cerr << "ERROR: No terms found in " << tokens_path << "\n";
         return 1;
     }
 
-    std::cout << "Read lines : " << lines << "\n";
+    std::cout << "Read lines : " << records + in.skipped() << "\n";
     std::cout << "Read bytes : " << bytes_read << "\n";
-    std::cout << "Tokens     : " << terms.size() << "\n";
-
-    std::sort(terms.begin(), terms.end());
-
-    std::vector<TermFreq> freqs;
-    freqs.reserve(terms.size() / 10);
-
-    uint32_t cur_count = 1;
-    std::string cur_term = terms[0];
-
-    for (size_t i = 1; i < terms.size(); i++) {
-        if (terms[i] == cur_term) {
-            cur_count++;
-        } else {
-            freqs.push_back({cur_term, cur_count});
-            cur_term = terms[i];
-            cur_count = 1;
+    std::cout << "Tokens     : " << records << "\n";
+
+    phase_timer.reset();
+
+    if (!phrases_out.empty()) {
+        std::vector<PhraseCandidate> cands;
+        for (const auto& [p, n] : pairs) {
+            if (n < phrases_min_count) continue;
+            const size_t sp = p.find(' ');
+            const double na = counts[p.substr(0, sp)];
+            const double nb = counts[p.substr(sp + 1)];
+            cands.push_back({p, n, std::log2((double)n * (double)pairs_total / (na * nb))});
+        }
+        std::sort(cands.begin(), cands.end(), [](const PhraseCandidate& a, const PhraseCandidate& b) {
+            if (a.pmi != b.pmi) return a.pmi > b.pmi;
+            return a.phrase < b.phrase;
+        });
+        if (cands.size() > phrases_top) cands.resize(phrases_top);
+
+        std::ofstream pout(phrases_out, std::ios::binary);
+        if (!pout) {
+            std::cerr << "ERROR: Cannot write: " << phrases_out << "\n";
+            return 1;
+        }
+        pout << "# PMI-кандидаты: пары соседних токенов, n >= " << phrases_min_count << "\n";
+        for (const auto& c : cands) {
+            pout << c.phrase << "\t# pmi " << c.pmi << ", n " << c.freq << "\n";
         }
+        reg.gauge("phrase_candidates", "Кандидатов в словарь словосочетаний").set((double)cands.size());
+        std::cout << "Phrase candidates: " << cands.size() << " -> " << phrases_out << "\n";
+        std::unordered_map<std::string, uint32_t>().swap(pairs);
     }
-    freqs.push_back({cur_term, cur_count});
 
-    std::vector<std::string>().swap(terms);
+    std::vector<TermFreq> freqs;
+    freqs.reserve(counts.size());
+    for (auto& [term, freq] : counts) {
+        freqs.push_back({term, freq});
+    }
+    std::unordered_map<std::string, uint32_t>().swap(counts);
 
     std::sort(freqs.begin(), freqs.end(), [](const TermFreq& a, const TermFreq& b) {
         if (a.freq != b.freq) return a.freq > b.freq;
         return a.term < b.term;
     });
 
+    reg.gauge("count_seconds", "Время сортировки частот, с").set(phase_timer.seconds());
+
     const uint32_t C = freqs[0].freq;
     const size_t V = freqs.size();
 
@@ -151,6 +213,13 @@ int main(int argc, char** argv) {
     }
     out2.close();
 
+    reg.gauge("vocabulary_size", "Число уникальных термов").set((double)V);
+    reg.gauge("rank1_freq", "Частота терма с рангом 1").set((double)C);
+    reg.gauge("elapsed_seconds", "Общее время работы, с").set(run_timer.seconds());
+    if (!metrics::dump_json(reg)) {
+        std::cerr << "ERROR: Cannot write metrics to " << metrics::metrics_dir() << "\n";
+    }
+
     std::cout << "Saved: " << out_rank << "\n";
     std::cout << "Saved: " << out_top << "\n";
     return 0;